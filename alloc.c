@@ -0,0 +1,252 @@
+/*** alloc.c counts the allocations, and with --alloc-report records every block with its call site ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "define.h"
+
+#define MAX_SITES 1024          /* call sites, a power of 2 */
+#define INITIAL_BLOCKS 4096     /* buckets of the block table, a power of 2 */
+
+/* the allocations of one call site */
+typedef struct {
+    const char *file;           /* NULL for a free slot */
+    int line;
+    long cnt;                   /* allocations, a realloc counts as one */
+    long bytes;                 /* bytes allocated */
+    long in_use;                /* bytes of the blocks which weren't freed yet */
+    long peak;                  /* largest in_use */
+    long cnt_in_use;            /* blocks which weren't freed yet */
+} alloc_site;
+
+/* a block in use */
+typedef struct block {
+    void *ptr;
+    size_t size;
+    alloc_site *site;
+    struct block *next;
+} block;
+
+per_thread long cnt_allocations;
+
+static bool tracking = FALSE;
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static alloc_site sites[MAX_SITES];
+static alloc_site other_sites = {"other", 0, 0, 0, 0, 0, 0};   /* when sites is full */
+static int cnt_sites = 0;
+static block **blocks = NULL;   /* hash table of the blocks in use, by address */
+static size_t size_blocks = 0, cnt_blocks = 0;
+
+/*** functions prototypes ***/
+
+/* Finds or adds the call site, called with the lock held */
+static alloc_site *site_of(const char *file, int line);
+
+/* Hash bucket of an address */
+static size_t bucket_of(void *ptr, size_t size_table);
+
+/* Records a new block, called with the lock held */
+static void add_block(void *ptr, size_t size, alloc_site *site);
+
+/* Forgets a block, returns its record to free or NULL if it isn't recorded, called with the lock held */
+static block *remove_block(void *ptr);
+
+/* Records an allocation of the call site, called with the lock held */
+static void record(void *ptr, size_t size, const char *file, int line);
+
+/* Orders the call sites by bytes, largest first */
+static int compare_sites(const void *a, const void *b);
+
+
+void *tracked_malloc(size_t size, const char *file, int line) {
+    void *ptr = malloc(size);
+
+    cnt_allocations++;
+    if (tracking && ptr != NULL) {
+        pthread_mutex_lock(&alloc_lock);
+        record(ptr, size, file, line);
+        pthread_mutex_unlock(&alloc_lock);
+    }
+    return ptr;
+}
+
+void *tracked_calloc(size_t cnt, size_t size, const char *file, int line) {
+    void *ptr = calloc(cnt, size);
+
+    cnt_allocations++;
+    if (tracking && ptr != NULL) {
+        pthread_mutex_lock(&alloc_lock);
+        record(ptr, cnt * size, file, line);
+        pthread_mutex_unlock(&alloc_lock);
+    }
+    return ptr;
+}
+
+void *tracked_realloc(void *ptr, size_t size, const char *file, int line) {
+    block *old;
+    void *new_ptr;
+
+    cnt_allocations++;
+    if (!tracking)
+        return realloc(ptr, size);
+
+    /* the old block is forgotten before another thread can get its address */
+    pthread_mutex_lock(&alloc_lock);
+    old = ptr != NULL ? remove_block(ptr) : NULL;
+    if ((new_ptr = realloc(ptr, size)) != NULL)
+        record(new_ptr, size, file, line);
+    else if (old != NULL)
+        add_block(ptr, old->size, old->site);
+    pthread_mutex_unlock(&alloc_lock);
+    free(old);
+    return new_ptr;
+}
+
+/* Frees a block, a block which wasn't allocated by the macros may be freed too */
+void tracked_free(void *ptr) {
+    block *b = NULL;
+
+    if (tracking && ptr != NULL) {
+        pthread_mutex_lock(&alloc_lock);
+        b = remove_block(ptr);
+        pthread_mutex_unlock(&alloc_lock);
+    }
+    free(b);
+    free(ptr);
+}
+
+/* Starts recording the call sites */
+void alloc_track() {
+    pthread_mutex_lock(&alloc_lock);
+    if (blocks == NULL) {
+        size_blocks = INITIAL_BLOCKS;
+        blocks = (block **)calloc(size_blocks, sizeof(block *));
+        valid_allocate(blocks);
+    }
+    tracking = TRUE;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+/* Prints the allocations of every call site */
+void alloc_report() {
+    alloc_site *sorted[MAX_SITES + 1];
+    long cnt = 0, bytes = 0, peak = 0, in_use = 0, cnt_in_use = 0;
+    int i, n = 0;
+
+    if (!tracking)
+        return;
+    pthread_mutex_lock(&alloc_lock);
+    for (i = 0; i < MAX_SITES; i++)
+        if (sites[i].file != NULL)
+            sorted[n++] = &sites[i];
+    if (other_sites.cnt > 0)
+        sorted[n++] = &other_sites;
+    qsort(sorted, n, sizeof(alloc_site *), compare_sites);
+
+    printf("\n\nAllocations\n");
+    printf("    %-24s %10s %12s %12s %10s %12s\n", "site", "count", "bytes", "peak bytes", "not freed", "bytes");
+    for (i = 0; i < n; i++) {
+        printf("    %-18s:%-5d %10ld %12ld %12ld %10ld %12ld\n", sorted[i]->file, sorted[i]->line, sorted[i]->cnt,
+               sorted[i]->bytes, sorted[i]->peak, sorted[i]->cnt_in_use, sorted[i]->in_use);
+        cnt += sorted[i]->cnt;
+        bytes += sorted[i]->bytes;
+        peak += sorted[i]->peak;
+        in_use += sorted[i]->in_use;
+        cnt_in_use += sorted[i]->cnt_in_use;
+    }
+    printf("    %-24s %10ld %12ld %12ld %10ld %12ld\n", "total", cnt, bytes, peak, cnt_in_use, in_use);
+    pthread_mutex_unlock(&alloc_lock);
+    fflush(stdout);
+}
+
+/* Finds or adds the call site */
+static alloc_site *site_of(const char *file, int line) {
+    unsigned long h = ((unsigned long)file * 31 + (unsigned long)line) & (MAX_SITES - 1);
+
+    /* a site is always at the same place of the same file, so its file name has one address */
+    while (sites[h].file != NULL && (sites[h].file != file || sites[h].line != line))
+        h = (h + 1) & (MAX_SITES - 1);
+    if (sites[h].file == NULL) {
+        if (cnt_sites == MAX_SITES - 1)
+            return &other_sites;
+        cnt_sites++;
+        sites[h].file = file;
+        sites[h].line = line;
+    }
+    return &sites[h];
+}
+
+/* Hash bucket of an address */
+static size_t bucket_of(void *ptr, size_t size_table) {
+    unsigned long h = (unsigned long)ptr;
+
+    h ^= h >> 17;
+    h *= 0x9e3779b1UL;
+    return (size_t)(h ^ (h >> 15)) & (size_table - 1);
+}
+
+/* Records a new block, the table grows when it holds 2 blocks per bucket */
+static void add_block(void *ptr, size_t size, alloc_site *site) {
+    block *b = (block *)malloc(sizeof(block)), **table, *cur, *next;
+    size_t i, h;
+
+    valid_allocate(b);
+    if (cnt_blocks >= 2 * size_blocks) {
+        table = (block **)calloc(2 * size_blocks, sizeof(block *));
+        valid_allocate(table);
+        for (i = 0; i < size_blocks; i++)
+            for (cur = blocks[i]; cur != NULL; cur = next) {
+                next = cur->next;
+                h = bucket_of(cur->ptr, 2 * size_blocks);
+                cur->next = table[h];
+                table[h] = cur;
+            }
+        free(blocks);
+        blocks = table;
+        size_blocks *= 2;
+    }
+    b->ptr = ptr;
+    b->size = size;
+    b->site = site;
+    h = bucket_of(ptr, size_blocks);
+    b->next = blocks[h];
+    blocks[h] = b;
+    cnt_blocks++;
+
+    site->in_use += size;
+    site->cnt_in_use++;
+    if (site->in_use > site->peak)
+        site->peak = site->in_use;
+}
+
+/* Forgets a block, returns its record to free or NULL if it isn't recorded */
+static block *remove_block(void *ptr) {
+    block **link = &blocks[bucket_of(ptr, size_blocks)], *b;
+
+    for (; *link != NULL; link = &(*link)->next)
+        if ((*link)->ptr == ptr) {
+            b = *link;
+            *link = b->next;
+            b->site->in_use -= b->size;
+            b->site->cnt_in_use--;
+            cnt_blocks--;
+            return b;
+        }
+    return NULL;
+}
+
+/* Records an allocation of the call site, a realloc moves the block to this site */
+static void record(void *ptr, size_t size, const char *file, int line) {
+    alloc_site *site = site_of(file, line);
+
+    site->cnt++;
+    site->bytes += size;
+    add_block(ptr, size, site);
+}
+
+/* Orders the call sites by bytes, largest first */
+static int compare_sites(const void *a, const void *b) {
+    long x = (*(alloc_site **)a)->bytes, y = (*(alloc_site **)b)->bytes;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
@@ -0,0 +1,28 @@
+#ifndef _ALLOC_H_
+#define _ALLOC_H_
+
+#include <stddef.h>
+
+/* Every allocation of the assembler goes through these macros, which pass the call site.
+ * The allocations of each thread are counted for --stats. With --alloc-report every block is
+ * also recorded with its call site, so the report shows per site the allocations, the bytes,
+ * the peak of the bytes in use and the blocks which were never freed. */
+#define asm_malloc(size) tracked_malloc((size), __FILE__, __LINE__)
+#define asm_calloc(cnt, size) tracked_calloc((cnt), (size), __FILE__, __LINE__)
+#define asm_realloc(ptr, size) tracked_realloc((ptr), (size), __FILE__, __LINE__)
+#define asm_free(ptr) tracked_free(ptr)
+
+void *tracked_malloc(size_t size, const char *file, int line);
+void *tracked_calloc(size_t cnt, size_t size, const char *file, int line);
+void *tracked_realloc(void *ptr, size_t size, const char *file, int line);
+
+/* Frees a block, a block which wasn't allocated by the macros (e.g. by open_memstream) may be freed too */
+void tracked_free(void *ptr);
+
+/* Starts recording the call sites, the blocks allocated before aren't in the report */
+void alloc_track();
+
+/* Prints the allocations of every call site, if they are recorded */
+void alloc_report();
+
+#endif
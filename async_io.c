@@ -0,0 +1,601 @@
+/*** async_io.c reads the sources and writes the outputs in the background ***/
+#define _DEFAULT_SOURCE    /* syscall */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "define.h"
+#include "async_io.h"
+#include "stats.h"
+
+#define RING_DEPTH 64      /* operations in flight on the ring */
+#define IO_THREADS 4       /* threads of the fallback */
+#define MAX_TRANSFER (1L << 30) /* bytes of one read or write */
+
+/* a file in memory */
+typedef struct io_file {
+    char *path;
+    char *tmp_path;        /* temporary file of a write */
+    char *text;
+    size_t len;
+    size_t done;           /* bytes read or written */
+    int fd;
+    bool write;
+    bool open;             /* an output which is still written to memory */
+    bool complete;         /* read or written, or failed */
+    bool failed;
+    bool pinned;           /* a written file which was opened for reading keeps its text */
+    bool superseded;       /* a later write of the same path replaces this one */
+    FILE *fp;              /* memory stream of an open output */
+    struct io_file *next;  /* all the files, the newest first */
+    struct io_file *next_queued;
+} io_file;
+
+typedef enum {
+    no_backend,
+    uring_backend,
+    thread_backend
+} backend_kind;
+
+static backend_kind backend = no_backend;
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_done = PTHREAD_COND_INITIALIZER;     /* an operation is complete */
+static pthread_cond_t io_queued = PTHREAD_COND_INITIALIZER;   /* an operation was queued */
+static io_file *files = NULL;
+static io_file *queue_head = NULL, *queue_tail = NULL;   /* operations waiting to be submitted */
+static int in_flight = 0;          /* operations on the ring */
+static int unfinished = 0;         /* operations queued or in flight */
+static int unsubmitted = 0;        /* entries on the submission ring not given to the kernel */
+static bool stopping = FALSE;
+static pthread_t threads[IO_THREADS];
+static int cnt_threads = 0;
+static long cnt_writes = 0;        /* for the names of the temporary files */
+
+/* the io_uring, the rings are shared with the kernel */
+static int ring_fd = -1;
+static unsigned *sq_tail, *sq_mask, *sq_array;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static void *sq_ring = NULL, *cq_ring = NULL;
+static size_t sq_ring_size, cq_ring_size, sqes_size;
+
+/*** functions prototypes ***/
+
+/* Sets up the io_uring, returns 0 if the kernel doesn't have it */
+static int setup_ring();
+
+/* Thread of the io_uring: reaps the completions and submits the queued operations */
+static void *reaper(void *arg);
+
+/* Thread of the fallback: does the queued operations with blocking calls */
+static void *io_thread(void *arg);
+
+/* Adds a file to the list, called with the lock */
+static io_file *new_file(char *path, bool write);
+
+/* Frees a file and removes it from the list, called with the lock */
+static void remove_file(io_file *f);
+
+/* Finds the newest file of the path which isn't an open output, called with the lock */
+static io_file *find_file(char *path);
+
+/* Queues an operation, called with the lock */
+static void enqueue(io_file *f);
+
+/* Submits the queued operations to the ring while it has room, called with the lock */
+static void submit_queued();
+
+/* Puts the rest of the transfer of the file on the submission ring, called with the lock */
+static void push_sqe(io_file *f);
+
+/* Gives the new submission entries to the kernel, called with the lock */
+static void flush_sqes();
+
+/* Opens the file of an operation, returns 0 if the operation is already complete */
+static int start_op(io_file *f);
+
+/* Closes the file of an operation and puts a written file in place, called with the lock */
+static void complete_op(io_file *f);
+
+
+/* Starts the backend, returns 0 and prints an error for an unknown backend */
+int async_start(char *name) {
+    int i;
+
+    /* A fatal error exits, the queued writes are done first */
+    atexit(async_stop);
+
+    if (strcmp(name, "uring") == 0 && setup_ring()) {
+        if (pthread_create(&threads[0], NULL, reaper, NULL) != 0) {
+            printf("Error: couldn't create the I/O thread\n");
+            exit(1);
+        }
+        cnt_threads = 1;
+        backend = uring_backend;
+        return 1;
+    }
+    /* Without io_uring the reads and writes are done by threads */
+    if (strcmp(name, "uring") != 0 && strcmp(name, "threads") != 0) {
+        printf("Error: unknown I/O backend '%s'\n", name);
+        return 0;
+    }
+    for (i = 0; i < IO_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, io_thread, NULL) != 0) {
+            printf("Error: couldn't create the I/O threads\n");
+            exit(1);
+        }
+    }
+    cnt_threads = IO_THREADS;
+    backend = thread_backend;
+    return 1;
+}
+
+/* Checks if the backend is running */
+int async_active() {
+    return backend != no_backend;
+}
+
+/* Queues the reads of the sources of the files, they are read in this order */
+void async_prefetch(char *files[], int cnt) {
+    char *path;
+    int i;
+
+    pthread_mutex_lock(&io_lock);
+    for (i = 0; i < cnt; i++) {
+        path = name_file(files[i], INPUT_FILE);
+        enqueue(new_file(path, FALSE));
+        asm_free(path);
+    }
+    pthread_mutex_unlock(&io_lock);
+}
+
+/* Opens a file for reading from memory, waits while it is being read */
+FILE *async_open_read(char *path) {
+    io_file *f;
+    FILE *fp = NULL;
+
+    if (backend == no_backend)
+        return NULL;
+    pthread_mutex_lock(&io_lock);
+    if ((f = find_file(path)) != NULL) {
+        /* The text of a write is complete before it is queued */
+        while (!f->write && !f->complete)
+            pthread_cond_wait(&io_done, &io_lock);
+        if (!f->failed || f->write) {
+            f->pinned = TRUE;
+            /* fmemopen wants at least one byte, an empty file starts at its end */
+            fp = fmemopen(f->len > 0 ? f->text : "", f->len > 0 ? f->len : 1, "r");
+            if (fp != NULL && f->len == 0)
+                fseek(fp, 0, SEEK_END);
+            stats_count(stat_bytes_read, f->len);
+        }
+    }
+    pthread_mutex_unlock(&io_lock);
+    return fp;
+}
+
+/* Drops the texts of the source and the macro file of a file, once it was compiled */
+void async_release(char *file_name) {
+    char *paths[2];
+    io_file *f, *next;
+    int i;
+
+    if (backend == no_backend)
+        return;
+    paths[0] = name_file(file_name, INPUT_FILE);
+    paths[1] = output_name(file_name, MACRO_FILE);
+    pthread_mutex_lock(&io_lock);
+    for (f = files; f != NULL; f = next) {
+        next = f->next;
+        for (i = 0; i < 2; i++) {
+            if (f->open || strcmp(f->path, paths[i]) != 0)
+                continue;
+            /* A write which is still queued is freed when it is complete */
+            if (f->complete)
+                remove_file(f);
+            else
+                f->pinned = FALSE;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&io_lock);
+    asm_free(paths[0]);
+    asm_free(paths[1]);
+}
+
+/* Opens an output in memory, async_close_write queues its write */
+FILE *async_open_write(char *path) {
+    io_file *f;
+    FILE *fp;
+
+    pthread_mutex_lock(&io_lock);
+    f = new_file(path, TRUE);
+    f->open = TRUE;
+    if ((fp = f->fp = open_memstream(&f->text, &f->len)) == NULL)
+        remove_file(f);
+    pthread_mutex_unlock(&io_lock);
+    return fp;
+}
+
+/* Drops an output in memory */
+void async_discard(FILE *fp) {
+    io_file *f;
+
+    fclose(fp);
+    pthread_mutex_lock(&io_lock);
+    for (f = files; f != NULL && f->fp != fp; f = f->next)
+        ;
+    if (f != NULL)
+        remove_file(f);
+    pthread_mutex_unlock(&io_lock);
+}
+
+/* Closes an output in memory and queues its write, returns 0 on failure */
+int async_close_write(FILE *fp) {
+    io_file *f, *old;
+    int ok;
+
+    /* Only the writer uses an open output, the text is set by fclose */
+    ok = fclose(fp) == 0;
+    pthread_mutex_lock(&io_lock);
+    for (f = files; f != NULL && f->fp != fp; f = f->next)
+        ;
+    if (f == NULL) {
+        pthread_mutex_unlock(&io_lock);
+        return 0;
+    }
+    f->fp = NULL;
+    f->open = FALSE;
+    if (!ok) {
+        remove_file(f);
+    } else {
+        /* The older writes of the path must not be renamed over this one */
+        for (old = f->next; old != NULL; old = old->next) {
+            if (old->write && !old->complete && strcmp(old->path, f->path) == 0)
+                old->superseded = TRUE;
+        }
+        f->tmp_path = (char *)asm_malloc(strlen(f->path) + 64);
+        valid_allocate(f->tmp_path);
+        sprintf(f->tmp_path, "%s.%ld.%ld.tmp", f->path, (long)getpid(), ++cnt_writes);
+        enqueue(f);
+    }
+    pthread_mutex_unlock(&io_lock);
+    return ok;
+}
+
+/* Waits for all the writes and stops the backend */
+void async_stop() {
+    struct io_uring_sqe *sqe;
+    unsigned tail;
+    int i;
+
+    if (backend == no_backend)
+        return;
+    pthread_mutex_lock(&io_lock);
+    while (unfinished > 0)
+        pthread_cond_wait(&io_done, &io_lock);
+    stopping = TRUE;
+    if (backend == uring_backend) {
+        /* A no-op with no file wakes the reaper */
+        tail = *sq_tail;
+        sqe = &sqes[tail & *sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_NOP;
+        sq_array[tail & *sq_mask] = tail & *sq_mask;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;
+        flush_sqes();
+    }
+    pthread_cond_broadcast(&io_queued);
+    pthread_mutex_unlock(&io_lock);
+
+    for (i = 0; i < cnt_threads; i++)
+        pthread_join(threads[i], NULL);
+    while (files != NULL) {
+        if (files->fp != NULL)
+            fclose(files->fp);
+        remove_file(files);
+    }
+    if (backend == uring_backend) {
+        munmap(sqes, sqes_size);
+        if (cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        munmap(sq_ring, sq_ring_size);
+        close(ring_fd);
+    }
+    backend = no_backend;
+    stopping = FALSE;
+    cnt_threads = 0;
+}
+
+/* Sets up the io_uring, returns 0 if the kernel doesn't have it */
+static int setup_ring() {
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    ring_fd = syscall(__NR_io_uring_setup, RING_DEPTH, &p);
+    if (ring_fd < 0)
+        return 0;
+
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if ((p.features & IORING_FEAT_SINGLE_MMAP) && cq_ring_size > sq_ring_size)
+        sq_ring_size = cq_ring_size;
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        close(ring_fd);
+        return 0;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            munmap(sq_ring, sq_ring_size);
+            close(ring_fd);
+            return 0;
+        }
+    }
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe *)mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        if (cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        munmap(sq_ring, sq_ring_size);
+        close(ring_fd);
+        return 0;
+    }
+
+    sq_tail = (unsigned *)((char *)sq_ring + p.sq_off.tail);
+    sq_mask = (unsigned *)((char *)sq_ring + p.sq_off.ring_mask);
+    sq_array = (unsigned *)((char *)sq_ring + p.sq_off.array);
+    cq_head = (unsigned *)((char *)cq_ring + p.cq_off.head);
+    cq_tail = (unsigned *)((char *)cq_ring + p.cq_off.tail);
+    cq_mask = (unsigned *)((char *)cq_ring + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)((char *)cq_ring + p.cq_off.cqes);
+    return 1;
+}
+
+/* Thread of the io_uring: reaps the completions and submits the queued operations */
+static void *reaper(void *arg) {
+    struct io_uring_cqe *cqe;
+    io_file *f;
+    unsigned head;
+    bool stop = FALSE;
+
+    while (!stop) {
+        if (syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+            printf("Error: io_uring failed\n");
+            exit(1);
+        }
+        pthread_mutex_lock(&io_lock);
+        head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &cqes[head & *cq_mask];
+            f = (io_file *)(unsigned long)cqe->user_data;
+            head++;
+            if (f == NULL) {
+                stop = TRUE;
+                continue;
+            }
+            in_flight--;
+            if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+                push_sqe(f);
+                continue;
+            }
+            if (cqe->res < 0 || (cqe->res == 0 && f->done < f->len)) {
+                f->failed = TRUE;
+                complete_op(f);
+                continue;
+            }
+            /* A short transfer goes on from where it stopped */
+            f->done += cqe->res;
+            if (f->done < f->len)
+                push_sqe(f);
+            else
+                complete_op(f);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        submit_queued();
+        pthread_mutex_unlock(&io_lock);
+    }
+    return NULL;
+}
+
+/* Thread of the fallback: does the queued operations with blocking calls */
+static void *io_thread(void *arg) {
+    io_file *f;
+    ssize_t n;
+
+    pthread_mutex_lock(&io_lock);
+    for (;;) {
+        while (queue_head == NULL && !stopping)
+            pthread_cond_wait(&io_queued, &io_lock);
+        if (queue_head == NULL)
+            break;
+        f = queue_head;
+        queue_head = f->next_queued;
+        if (queue_head == NULL)
+            queue_tail = NULL;
+        pthread_mutex_unlock(&io_lock);
+
+        if (start_op(f)) {
+            while (f->done < f->len) {
+                if (f->write)
+                    n = pwrite(f->fd, f->text + f->done, f->len - f->done, f->done);
+                else
+                    n = pread(f->fd, f->text + f->done, f->len - f->done, f->done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0) {
+                    f->failed = TRUE;
+                    break;
+                }
+                f->done += n;
+            }
+        }
+
+        pthread_mutex_lock(&io_lock);
+        complete_op(f);
+    }
+    pthread_mutex_unlock(&io_lock);
+    return NULL;
+}
+
+/* Adds a file to the list, called with the lock */
+static io_file *new_file(char *path, bool write) {
+    io_file *f = (io_file *)asm_calloc(1, sizeof(io_file));
+
+    valid_allocate(f);
+    f->path = (char *)asm_malloc(strlen(path) + 1);
+    valid_allocate(f->path);
+    strcpy(f->path, path);
+    f->fd = -1;
+    f->write = write;
+    f->next = files;
+    files = f;
+    return f;
+}
+
+/* Frees a file and removes it from the list, called with the lock */
+static void remove_file(io_file *f) {
+    io_file **p;
+
+    for (p = &files; *p != NULL && *p != f; p = &(*p)->next)
+        ;
+    if (*p != NULL)
+        *p = f->next;
+    asm_free(f->path);
+    asm_free(f->tmp_path);
+    asm_free(f->text);
+    asm_free(f);
+}
+
+/* Finds the newest file of the path which isn't an open output, called with the lock */
+static io_file *find_file(char *path) {
+    io_file *f;
+
+    for (f = files; f != NULL; f = f->next) {
+        if (!f->open && strcmp(f->path, path) == 0)
+            return f;
+    }
+    return NULL;
+}
+
+/* Queues an operation, called with the lock */
+static void enqueue(io_file *f) {
+    f->next_queued = NULL;
+    if (queue_tail != NULL)
+        queue_tail->next_queued = f;
+    else
+        queue_head = f;
+    queue_tail = f;
+    unfinished++;
+    if (backend == uring_backend)
+        submit_queued();
+    else
+        pthread_cond_signal(&io_queued);
+}
+
+/* Submits the queued operations to the ring while it has room, called with the lock */
+static void submit_queued() {
+    io_file *f;
+
+    while (queue_head != NULL && in_flight < RING_DEPTH) {
+        f = queue_head;
+        queue_head = f->next_queued;
+        if (queue_head == NULL)
+            queue_tail = NULL;
+        if (start_op(f))
+            push_sqe(f);
+        else
+            complete_op(f);
+    }
+    flush_sqes();
+}
+
+/* Puts the rest of the transfer of the file on the submission ring, called with the lock */
+static void push_sqe(io_file *f) {
+    struct io_uring_sqe *sqe;
+    unsigned tail = *sq_tail, index = tail & *sq_mask;
+    size_t len = f->len - f->done;
+
+    sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = f->write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = f->fd;
+    sqe->addr = (unsigned long)(f->text + f->done);
+    sqe->len = len > MAX_TRANSFER ? MAX_TRANSFER : len;
+    sqe->off = f->done;
+    sqe->user_data = (unsigned long)f;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    in_flight++;
+    unsubmitted++;
+}
+
+/* Gives the new submission entries to the kernel, called with the lock */
+static void flush_sqes() {
+    int n;
+
+    while (unsubmitted > 0) {
+        n = syscall(__NR_io_uring_enter, ring_fd, unsubmitted, 0, 0, NULL, 0);
+        if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            printf("Error: io_uring failed\n");
+            exit(1);
+        }
+        if (n > 0)
+            unsubmitted -= n;
+    }
+}
+
+/* Opens the file of an operation, returns 0 if the operation is already complete */
+static int start_op(io_file *f) {
+    struct stat st;
+
+    if (f->write) {
+        f->fd = open(f->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    } else {
+        f->fd = open(f->path, O_RDONLY);
+        if (f->fd >= 0 && fstat(f->fd, &st) == 0) {
+            f->len = st.st_size;
+            f->text = (char *)asm_malloc(f->len + 1);
+            valid_allocate(f->text);
+        } else if (f->fd >= 0) {
+            close(f->fd);
+            f->fd = -1;
+        }
+    }
+    if (f->fd < 0) {
+        f->failed = TRUE;
+        return 0;
+    }
+    return f->done < f->len;
+}
+
+/* Closes the file of an operation and puts a written file in place, called with the lock */
+static void complete_op(io_file *f) {
+    if (f->fd >= 0 && close(f->fd) != 0)
+        f->failed = TRUE;
+    f->fd = -1;
+    if (f->write) {
+        if (f->failed)
+            printf("Error: can't write file %s\n", f->path);
+        if (f->failed || f->superseded || rename(f->tmp_path, f->path) != 0)
+            remove(f->tmp_path);
+    }
+    f->complete = TRUE;
+    unfinished--;
+    /* The text of a write is kept only for its readers */
+    if (f->write && !f->pinned)
+        remove_file(f);
+    pthread_cond_broadcast(&io_done);
+}
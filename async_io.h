@@ -0,0 +1,44 @@
+#ifndef _ASYNC_IO_H_
+#define _ASYNC_IO_H_
+
+#include <stdio.h>
+
+/* Asynchronous file I/O for runs of many files (--io uring or --io threads).
+ * The sources are read in the background before their files are compiled, and
+ * the outputs are written in the background while the next files are compiled.
+ *
+ * Reads and writes are queued and submitted in batches, to io_uring when the
+ * kernel has it and to a few I/O threads otherwise. A file which was read, or
+ * whose write is still queued, is opened for reading from memory.
+ * An output is written to a temporary file which is renamed when it is complete. */
+
+/* Starts the backend, "uring" (threads if the kernel has no io_uring) or "threads".
+ * Returns 0 and prints an error for an unknown backend */
+int async_start(char *backend);
+
+/* Checks if the backend is running */
+int async_active();
+
+/* Queues the reads of the sources of the files (names without extension), they are read in this order */
+void async_prefetch(char *files[], int cnt);
+
+/* Opens a file for reading from memory, waits while it is being read.
+ * Returns NULL if the file isn't in memory or couldn't be read */
+FILE *async_open_read(char *path);
+
+/* Drops the texts of the source and the macro file of a file, once it was compiled */
+void async_release(char *file_name);
+
+/* Opens an output in memory, async_close_write queues its write */
+FILE *async_open_write(char *path);
+
+/* Drops an output in memory */
+void async_discard(FILE *fp);
+
+/* Closes an output in memory and queues its write, returns 0 on failure */
+int async_close_write(FILE *fp);
+
+/* Waits for all the writes and stops the backend */
+void async_stop();
+
+#endif
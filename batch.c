@@ -0,0 +1,259 @@
+/*** batch.c compiles many files at once on the work-stealing scheduler ***/
+#include <pthread.h>
+#include <sys/stat.h>
+#include "compile.h"
+#include "pre_processor.h"
+#include "parallel.h"
+#include "scheduler.h"
+#include "diag.h"
+#include "cache.h"
+#include "async_io.h"
+#include "batch.h"
+#include "probes.h"
+
+/* a file of the batch */
+typedef struct file_job {
+    char *name;            /* the file name without extension */
+    int position;          /* position on the command line */
+    long size;             /* size of the as_file, big files are started first */
+    parallel_unit *unit;
+    diag_buffer diag;      /* diagnostics of the file */
+    int remaining;         /* chunk tasks of the current stage which are not done */
+    bool done;
+    bool failed;           /* a fatal error stopped the file */
+    char key[CACHE_KEY_SIZE]; /* key of the file in the output cache */
+    struct batch *batch;
+} file_job;
+
+typedef struct batch {
+    file_job *jobs;
+    int cnt;
+    int next_to_print;     /* first file whose diagnostics were not printed */
+    pthread_mutex_t print_lock;
+    diag_buffer *out;      /* where the diagnostics are printed, NULL for stdout */
+    scheduler *s;
+} batch;
+
+/*** functions prototypes ***/
+
+/* Task: expands the macros of the file and splits it to chunks */
+static void preprocess_task(void *arg, int index);
+
+/* Runs the chunk step on every chunk, the last chunk to finish calls next */
+static void run_chunks(file_job *job, task_fn step, void (*next)(file_job *));
+
+/* Tasks of the chunk steps */
+static void parse_task(void *arg, int index);
+static void place_task(void *arg, int index);
+static void encode_task(void *arg, int index);
+
+/* Stages which run once all the chunks of the previous stage are done */
+static void after_parse(file_job *job);
+static void after_place(file_job *job);
+static void after_encode(file_job *job);
+
+/* Task: writes the output files */
+static void write_task(void *arg, int index);
+
+/* Marks the file as done and prints the diagnostics of the files which are done, in order */
+static void finish_job(file_job *job);
+
+/* Orders the files by size, the largest first */
+static int by_size(const void *a, const void *b);
+
+
+/* compiles the files on the given number of worker threads, returns 1 if a file had a fatal error */
+int assemble_batch(char *files[], int cnt, int jobs) {
+    scheduler *s = scheduler_create(jobs);
+    int status;
+
+    status = assemble_on(s, files, cnt);
+    scheduler_destroy(s);
+    return status;
+}
+
+/* compiles the files on a running scheduler, returns 1 if a file had a fatal error */
+int assemble_on(scheduler *s, char *files[], int cnt) {
+    batch b;
+    file_job **order;
+    struct stat st;
+    char *asfile_name;
+    int i, status = 0;
+
+    b.cnt = cnt;
+    b.next_to_print = 0;
+    b.out = diag_current();
+    b.s = s;
+    b.jobs = (file_job *)asm_calloc(cnt + 1, sizeof(file_job));
+    order = (file_job **)asm_calloc(cnt + 1, sizeof(file_job *));
+    valid_allocate(b.jobs);
+    valid_allocate(order);
+    pthread_mutex_init(&b.print_lock, NULL);
+
+    for (i = 0; i < cnt; i++) {
+        b.jobs[i].name = files[i];
+        b.jobs[i].position = i;
+        b.jobs[i].batch = &b;
+        asfile_name = name_file(files[i], INPUT_FILE);
+        b.jobs[i].size = stat(asfile_name, &st) == 0 ? (long)st.st_size : 0;
+        asm_free(asfile_name);
+        order[i] = &b.jobs[i];
+    }
+    /* The largest files have the longest chains of stages, start them first */
+    qsort(order, cnt, sizeof(file_job *), by_size);
+
+    /* The sources are read in the background, in the order they are started */
+    if (async_active()) {
+        for (i = 0; i < cnt; i++)
+            async_prefetch(&order[i]->name, 1);
+    }
+
+    for (i = 0; i < cnt; i++)
+        scheduler_spawn(b.s, preprocess_task, order[i], 0);
+    scheduler_wait(b.s);
+
+    for (i = 0; i < cnt; i++) {
+        if (b.jobs[i].failed)
+            status = 1;
+    }
+    pthread_mutex_destroy(&b.print_lock);
+    asm_free(order);
+    asm_free(b.jobs);
+    return status;
+}
+
+/* Orders the files by size, the largest first */
+static int by_size(const void *a, const void *b) {
+    long size_a = (*(file_job **)a)->size, size_b = (*(file_job **)b)->size;
+    return size_a < size_b ? 1 : size_a > size_b ? -1 : 0;
+}
+
+/* Task: expands the macros of the file and splits it to chunks */
+static void preprocess_task(void *arg, int index) {
+    file_job *job = (file_job *)arg;
+    diag_buffer *prev;
+    jmp_buf fatal, *prev_fatal;
+    char *asfile_name;
+    int ok;
+
+    probe1(file_start, job->name);
+    prev = diag_redirect(&job->diag);
+    /* An unchanged source is restored from the cache */
+    if (cache_restore(job->name, job->key)) {
+        diag_redirect(prev);
+        finish_job(job);
+        return;
+    }
+    prev_fatal = catch_fatal(&fatal);
+    if (setjmp(fatal) == 0) {
+        ok = pre_processor(job->name);
+        if (!ok) {
+            asfile_name = name_file(job->name, INPUT_FILE);
+            diag_printf("\nErrors in Macros declarations and implematation, failed to process file '%s.\n",asfile_name);
+            asm_free(asfile_name);
+        } else {
+            job->unit = unit_create(job->name, scheduler_workers(job->batch->s), &job->diag);
+        }
+    } else {
+        /* A file couldn't be opened, the other files go on */
+        job->failed = TRUE;
+        ok = 0;
+    }
+    catch_fatal(prev_fatal);
+    diag_redirect(prev);
+    if (!ok) {
+        finish_job(job);
+        return;
+    }
+    run_chunks(job, parse_task, after_parse);
+}
+
+/* Runs the chunk step on every chunk, the last chunk to finish calls next */
+static void run_chunks(file_job *job, task_fn step, void (*next)(file_job *)) {
+    int i, cnt = unit_chunks(job->unit);
+
+    /* A small file is not worth the tasks */
+    if (cnt <= 1) {
+        if (cnt == 1)
+            step(job, -1);
+        next(job);
+        return;
+    }
+    job->remaining = cnt;
+    for (i = 0; i < cnt; i++)
+        scheduler_spawn(job->batch->s, step, job, i);
+}
+
+/* Chunk step tasks, the index -1 stands for the only chunk of a small file */
+#define chunk_task(name, step, next) \
+static void name(void *arg, int index) { \
+    file_job *job = (file_job *)arg; \
+    step(index < 0 ? 0 : index, job->unit); \
+    if (index >= 0 && __atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL) == 0) \
+        next(job); \
+}
+
+chunk_task(parse_task, parse_chunk, after_parse)
+chunk_task(place_task, place_chunk, after_place)
+chunk_task(encode_task, encode_chunk, after_encode)
+
+/* All the chunks are parsed */
+static void after_parse(file_job *job) {
+    unit_addresses(job->unit);
+    run_chunks(job, place_task, after_place);
+}
+
+/* All the chunks are at their addresses */
+static void after_place(file_job *job) {
+    if (unit_first_iteration(job->unit))
+        run_chunks(job, encode_task, after_encode);
+    else
+        scheduler_spawn(job->batch->s, write_task, job, 0);
+}
+
+/* All the chunks are encoded */
+static void after_encode(file_job *job) {
+    unit_merge_chunks(job->unit);
+    scheduler_spawn(job->batch->s, write_task, job, 0);
+}
+
+/* Task: writes the output files */
+static void write_task(void *arg, int index) {
+    file_job *job = (file_job *)arg;
+    diag_buffer *prev = diag_current();
+    jmp_buf fatal, *prev_fatal;
+
+    prev_fatal = catch_fatal(&fatal);
+    if (setjmp(fatal) == 0)
+        unit_write(job->unit);
+    else
+        job->failed = TRUE;
+    catch_fatal(prev_fatal);
+    diag_redirect(prev);
+    unit_destroy(job->unit);
+    job->unit = NULL;
+    finish_job(job);
+}
+
+/* Marks the file as done and prints the diagnostics of the files which are done, in order */
+static void finish_job(file_job *job) {
+    batch *b = job->batch;
+    diag_buffer *prev;
+
+    if (!job->failed)
+        cache_store(job->name, job->key, &job->diag);
+    async_release(job->name);
+    probe1(file_end, job->name);
+
+    pthread_mutex_lock(&b->print_lock);
+    job->done = TRUE;
+    prev = diag_redirect(b->out);
+    while (b->next_to_print < b->cnt && b->jobs[b->next_to_print].done) {
+        diag_flush(&b->jobs[b->next_to_print].diag);
+        b->next_to_print++;
+    }
+    diag_redirect(prev);
+    if (b->out == NULL)
+        fflush(stdout);
+    pthread_mutex_unlock(&b->print_lock);
+}
@@ -0,0 +1,17 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "scheduler.h"
+
+/* Multi-file driver: every file is broken into tasks (pre process, parse chunks,
+ * place chunks, symbols, encode chunks, merge, write output) which run on the
+ * work-stealing scheduler, so idle workers help with the large files.
+ * The diagnostics of every file are printed in the order of the files. */
+
+/* compiles the files on the given number of worker threads, returns 1 if a file had a fatal error */
+int assemble_batch(char *files[], int cnt, int jobs);
+
+/* compiles the files on a running scheduler, returns 1 if a file had a fatal error */
+int assemble_on(scheduler *s, char *files[], int cnt);
+
+#endif
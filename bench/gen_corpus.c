@@ -0,0 +1,258 @@
+/* gen_corpus.c writes a corpus of valid .as files for benchmarking the assembler.
+ * The size and the mix of the statements are set by the options, the same seed gives the same corpus.
+ * A file holds at most MAX_CODE - INITIAL words of memory, so a large corpus is split over many files.
+ * The base names of the files are written to <dir>/<name>.list, for run_bench. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../define.h"
+
+#define FILE_WORDS (MAX_CODE - INITIAL - 24) /* words of a file, with room for the last statement */
+#define CNT_MACROS 4          /* macros defined at the top of a file */
+#define MACRO_LINES 2         /* lines of a macro body */
+#define MACRO_WORDS 4         /* words of an expansion */
+#define CNT_EXTERNS 8         /* externs declared at the top of a file */
+#define MAX_DATA_VALUES 8
+#define MAX_STRING 20
+#define MAX_PATH 4096
+
+/* the knobs of the corpus */
+typedef struct {
+    long lines;          /* lines of the corpus */
+    long file_lines;     /* largest number of lines in a file, 0 for as many as fit in the memory */
+    int macro_pct;       /* lines which call a macro */
+    int label_pct;       /* statements with a label */
+    int extern_pct;      /* label operands which refer to an extern */
+    int entry_pct;       /* labels declared as entries */
+    int data_pct;        /* .data lines */
+    int string_pct;      /* .string lines */
+    int comment_pct;     /* comment and empty lines */
+    unsigned long seed;
+    char *dir;
+    char *name;
+} corpus_knobs;
+
+/* operand types of the instructions, as in the table of syntax.c: I immediate, L label, R register */
+static struct {
+    char *name;
+    char *src;
+    char *dest;
+} instructs[NUM_OF_INSTRUCTS] = {
+    {"mov", "ILR", "LR"}, {"cmp", "ILR", "ILR"}, {"add", "ILR", "LR"}, {"sub", "ILR", "LR"},
+    {"not", NULL, "LR"}, {"clr", NULL, "LR"}, {"lea", "L", "LR"}, {"inc", NULL, "LR"},
+    {"dec", NULL, "LR"}, {"jmp", NULL, "LR"}, {"bne", NULL, "LR"}, {"red", NULL, "LR"},
+    {"prn", NULL, "ILR"}, {"jsr", NULL, "LR"}, {"rts", NULL, NULL}, {"stop", NULL, NULL}
+};
+
+static unsigned long rand_state;
+
+/*** functions prototypes ***/
+
+/* Returns a random number in [0, n) */
+static long random_below(long n);
+
+/* Returns a random number in [low, high] */
+static long random_range(long low, long high);
+
+/* Parses the options, returns 0 on a bad option */
+static int parse_knobs(int argc, char *argv[], corpus_knobs *knobs);
+
+/* Writes one file of the corpus with at most max_lines lines, returns the number of lines written */
+static long write_file(FILE *out, corpus_knobs *knobs, long max_lines);
+
+/* Writes an operand of one of the types to the text, returns 1 if it is a register */
+static int write_operand(char *text, char *types, long cnt_labels, int extern_pct);
+
+
+int main(int argc, char *argv[]) {
+    corpus_knobs knobs;
+    char path[MAX_PATH];
+    long lines = 0, cnt_files = 0, max_lines;
+    FILE *list, *out;
+
+    if (!parse_knobs(argc, argv, &knobs)) {
+        fprintf(stderr, "usage: %s [-l lines] [-f lines per file] [-m macro%%] [-b label%%] [-x extern%%] [-e entry%%]\n"
+                        "          [-d data%%] [-s string%%] [-c comment%%] [-S seed] [-o dir] [-n name]\n", argv[0]);
+        return 1;
+    }
+    rand_state = knobs.seed;
+
+    sprintf(path, "%s/%s.list", knobs.dir, knobs.name);
+    if ((list = fopen(path, "w")) == NULL) {
+        fprintf(stderr, "Error: can't create file: %s\n", path);
+        return 1;
+    }
+    while (lines < knobs.lines) {
+        sprintf(path, "%s/%s_%ld%s", knobs.dir, knobs.name, ++cnt_files, INPUT_FILE);
+        if ((out = fopen(path, "w")) == NULL) {
+            fprintf(stderr, "Error: can't create file: %s\n", path);
+            fclose(list);
+            return 1;
+        }
+        max_lines = knobs.lines - lines;
+        if (knobs.file_lines > 0 && knobs.file_lines < max_lines)
+            max_lines = knobs.file_lines;
+        lines += write_file(out, &knobs, max_lines);
+        fclose(out);
+        fprintf(list, "%s/%s_%ld\n", knobs.dir, knobs.name, cnt_files);
+    }
+    fclose(list);
+    printf("%ld lines in %ld files\n", lines, cnt_files);
+    return 0;
+}
+
+/* Returns a random number in [0, n) */
+static long random_below(long n) {
+    rand_state = rand_state * 6364136223846793005UL + 1442695040888963407UL;
+    return (long)((rand_state >> 33) % (unsigned long)n);
+}
+
+/* Returns a random number in [low, high] */
+static long random_range(long low, long high) {
+    return low + random_below(high - low + 1);
+}
+
+/* Parses the options, returns 0 on a bad option */
+static int parse_knobs(int argc, char *argv[], corpus_knobs *knobs) {
+    int i;
+    char *end;
+    long value;
+
+    knobs->lines = 10000;
+    knobs->file_lines = 0;
+    knobs->macro_pct = 5;
+    knobs->label_pct = 20;
+    knobs->extern_pct = 10;
+    knobs->entry_pct = 10;
+    knobs->data_pct = 10;
+    knobs->string_pct = 5;
+    knobs->comment_pct = 10;
+    knobs->seed = 1;
+    knobs->dir = ".";
+    knobs->name = "corpus";
+
+    for (i = 1; i < argc; i++) {
+        if (strlen(argv[i]) != 2 || argv[i][0] != '-' || i + 1 == argc)
+            return 0;
+        if (argv[i][1] == 'o') {
+            knobs->dir = argv[++i];
+            continue;
+        }
+        if (argv[i][1] == 'n') {
+            knobs->name = argv[++i];
+            continue;
+        }
+        value = strtol(argv[++i], &end, 10);
+        if (*end != '\0' || value < 0)
+            return 0;
+        switch (argv[i - 1][1]) {
+            case 'l': knobs->lines = value; break;
+            case 'f': knobs->file_lines = value; break;
+            case 'm': knobs->macro_pct = (int)value; break;
+            case 'b': knobs->label_pct = (int)value; break;
+            case 'x': knobs->extern_pct = (int)value; break;
+            case 'e': knobs->entry_pct = (int)value; break;
+            case 'd': knobs->data_pct = (int)value; break;
+            case 's': knobs->string_pct = (int)value; break;
+            case 'c': knobs->comment_pct = (int)value; break;
+            case 'S': knobs->seed = (unsigned long)value; break;
+            default: return 0;
+        }
+    }
+    return knobs->macro_pct + knobs->data_pct + knobs->string_pct + knobs->comment_pct <= 100 &&
+           knobs->label_pct <= 100 && knobs->extern_pct <= 100 && knobs->entry_pct <= 100;
+}
+
+/* Writes one file of the corpus with at most max_lines lines, returns the number of lines written */
+static long write_file(FILE *out, corpus_knobs *knobs, long max_lines) {
+    long lines = 0, words = 0, cnt_labels = 0, cnt_macros = 0, i;
+    char src[MAX_SYMBOL_LENGTH], dest[MAX_SYMBOL_LENGTH];
+    int roll, kind, j, cnt, src_reg, dest_reg;
+
+    for (i = 1; i <= CNT_EXTERNS && lines < max_lines; i++, lines++)
+        fprintf(out, ".extern X%ld\n", i);
+    if (knobs->macro_pct > 0)
+        for (; cnt_macros < CNT_MACROS && lines + MACRO_LINES + 2 <= max_lines; cnt_macros++, lines += MACRO_LINES + 2)
+            fprintf(out, "mcro m%ld\n inc @r%ld\n mov @r%ld, @r%ld\nendmcro\n",
+                    cnt_macros + 1, cnt_macros + 1, cnt_macros + 1, cnt_macros + 2);
+
+    /* the entries are declared at the end, keep a line for every expected entry */
+    while (lines < max_lines - (cnt_labels * knobs->entry_pct + 99) / 100 && words < FILE_WORDS) {
+        roll = (int)random_below(100);
+        lines++;
+        if (roll < knobs->comment_pct) {
+            fprintf(out, random_below(4) == 0 ? "\n" : "; comment %ld\n", lines);
+            continue;
+        }
+        roll -= knobs->comment_pct;
+        if (roll < knobs->macro_pct && cnt_macros > 0) {
+            fprintf(out, " m%ld\n", random_range(1, cnt_macros));
+            words += MACRO_WORDS;
+            continue;
+        }
+        roll -= knobs->macro_pct;
+        kind = roll < knobs->data_pct ? 'd' : roll < knobs->data_pct + knobs->string_pct ? 's' : 'i';
+
+        if (random_below(100) < knobs->label_pct)
+            fprintf(out, "L%ld: ", ++cnt_labels);
+        if (kind == 'd') {
+            /* the bounds of .data are not valid values */
+            cnt = (int)random_range(1, MAX_DATA_VALUES);
+            fprintf(out, " .data %ld", random_range(MIN_DATA + 1, MAX_DATA - 1));
+            for (j = 1; j < cnt; j++)
+                fprintf(out, ", %ld", random_range(MIN_DATA + 1, MAX_DATA - 1));
+            words += cnt;
+        }
+        else if (kind == 's') {
+            cnt = (int)random_range(1, MAX_STRING);
+            fprintf(out, " .string \"");
+            for (j = 0; j < cnt; j++)
+                fputc((int)random_range('a', 'z'), out);
+            fputc('"', out);
+            words += cnt + 1;
+        }
+        else {
+            j = (int)random_below(NUM_OF_INSTRUCTS);
+            fprintf(out, " %s", instructs[j].name);
+            words++;
+            src_reg = dest_reg = 0;
+            if (instructs[j].src != NULL) {
+                src_reg = write_operand(src, instructs[j].src, cnt_labels, knobs->extern_pct);
+                fprintf(out, " %s,", src);
+                words++;
+            }
+            if (instructs[j].dest != NULL) {
+                dest_reg = write_operand(dest, instructs[j].dest, cnt_labels, knobs->extern_pct);
+                fprintf(out, " %s", dest);
+                if (!(src_reg && dest_reg))
+                    words++;
+            }
+        }
+        fputc('\n', out);
+    }
+
+    for (i = 1; i <= cnt_labels && lines < max_lines; i++)
+        if (random_below(100) < knobs->entry_pct) {
+            fprintf(out, ".entry L%ld\n", i);
+            lines++;
+        }
+    return lines;
+}
+
+/* Writes an operand of one of the types to the text, returns 1 if it is a register */
+static int write_operand(char *text, char *types, long cnt_labels, int extern_pct) {
+    char type = types[random_below((long)strlen(types))];
+
+    if (type == 'R') {
+        sprintf(text, "@r%ld", random_below(NUM_OF_REGISTERS));
+        return 1;
+    }
+    if (type == 'I')
+        sprintf(text, "%ld", random_range(MIN_INTEGER, MAX_INTEGER));
+    else if (cnt_labels == 0 || random_below(100) < extern_pct)
+        sprintf(text, "X%ld", random_range(1, CNT_EXTERNS));
+    else
+        sprintf(text, "L%ld", random_range(1, cnt_labels));
+    return 0;
+}
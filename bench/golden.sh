@@ -0,0 +1,120 @@
+#!/bin/sh
+# golden.sh runs the shipped assembler and a new build over the same corpus, checks that the
+# .am, .ob, .ent and .ext files are byte-identical and reports the throughput ratio.
+# usage: golden.sh [-r reference] [-n runs] <assembler> <list> [assembler options]
+# The list holds the base names of the sources, one per line, as written by gen_corpus.
+# The reference is the assembler binary committed to git by default. The options are passed
+# to the new build only. Exit status: 0 identical, 1 different, 2 the reference can't run here.
+
+ref=""
+runs=3
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -r) ref="$2"; shift 2 ;;
+        -n) runs="$2"; shift 2 ;;
+        *) break ;;
+    esac
+done
+if [ $# -lt 2 ]; then
+    echo "usage: $0 [-r reference] [-n runs] <assembler> <list> [assembler options]" >&2
+    exit 1
+fi
+new=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+list="$2"
+shift 2
+if [ ! -r "$list" ]; then
+    echo "Error: can't open file: $list" >&2
+    exit 1
+fi
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/golden.XXXXXX") || exit 1
+trap 'rm -rf "$work"' EXIT
+
+if [ -z "$ref" ]; then
+    ref="$work/assembler.ref"
+    if ! git -C "$(dirname "$0")" show HEAD:assembler > "$ref" 2>/dev/null; then
+        echo "Error: no assembler binary in git, give one with -r" >&2
+        exit 1
+    fi
+    chmod +x "$ref"
+else
+    ref=$(cd "$(dirname "$ref")" && pwd)/$(basename "$ref")
+fi
+
+# the shipped binary is a 32-bit ELF, the machine may not be able to run it
+mkdir "$work/probe"
+printf ' stop\n' > "$work/probe/probe.as"
+(cd "$work/probe" && "$ref" probe) > "$work/probe.log" 2>&1
+status=$?
+if [ $status -ge 126 ] || [ ! -f "$work/probe/probe.ob" ]; then
+    echo "Error: the reference assembler can't run on this machine (status $status):"
+    head -3 "$work/probe.log"
+    echo "A 32-bit binary needs the i386 loader and libc (e.g. libc6:i386), or give a reference with -r"
+    exit 2
+fi
+
+# every binary compiles its own copy of the corpus, the names are relative to it
+names=""
+mkdir "$work/ref" "$work/new"
+i=0
+while read -r base; do
+    [ -n "$base" ] || continue
+    i=$((i + 1))
+    cp "$base.as" "$work/ref/f$i.as" && cp "$base.as" "$work/new/f$i.as" || exit 1
+    names="$names f$i"
+done < "$list"
+if [ $i -eq 0 ]; then
+    echo "Error: no sources in $list" >&2
+    exit 1
+fi
+lines=$(cat "$work"/ref/*.as | wc -l)
+echo "corpus: $i files, $lines lines"
+
+# runs a binary over its copy of the corpus with the options, prints the best time in nanoseconds
+best_time() {
+    bin="$1"
+    dir="$2"
+    shift 2
+    best=""
+    n=0
+    while [ $n -lt "$runs" ]; do
+        rm -f "$dir"/*.am "$dir"/*.ob "$dir"/*.ent "$dir"/*.ext
+        start=$(date +%s%N)
+        (cd "$dir" && "$bin" $names "$@" > "$dir.log" 2>&1)
+        end=$(date +%s%N)
+        t=$((end - start))
+        if [ -z "$best" ] || [ $t -lt "$best" ]; then
+            best=$t
+        fi
+        n=$((n + 1))
+    done
+    echo "$best"
+}
+
+ref_ns=$(best_time "$ref" "$work/ref")
+new_ns=$(best_time "$new" "$work/new" "$@")
+
+different=0
+for f in $names; do
+    for type in am ob ent ext; do
+        if [ -f "$work/ref/$f.$type" ] || [ -f "$work/new/$f.$type" ]; then
+            if ! cmp -s "$work/ref/$f.$type" "$work/new/$f.$type"; then
+                src=$(sed -n "${f#f}p" "$list")
+                echo "different: $src.$type"
+                different=$((different + 1))
+            fi
+        fi
+    done
+done
+
+awk -v lines="$lines" -v r="$ref_ns" -v n="$new_ns" 'BEGIN {
+    printf "reference: %.3f s, %.0f lines/s\n", r / 1e9, lines / (r / 1e9)
+    printf "new:       %.3f s, %.0f lines/s\n", n / 1e9, lines / (n / 1e9)
+    printf "throughput ratio (new / reference): %.2fx\n", r / n
+}'
+if [ $different -ne 0 ]; then
+    echo "$different output files are different"
+    exit 1
+fi
+echo "all outputs are identical"
+exit 0
@@ -0,0 +1,308 @@
+/* microbench.c times the hot functions of the assembler on fixed inputs.
+ * usage: microbench [name]   runs every benchmark, or the ones whose name starts with name
+ * Every benchmark doubles its number of operations until a run takes MIN_SECONDS, then prints
+ * the time per operation and the allocations per operation, as counted by alloc.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../define.h"
+#include "../compile.h"
+#include "../pre_processor.h"
+#include "../emit.h"
+
+#define MIN_SECONDS 0.2
+#define CNT_SYMBOLS 64       /* symbols of the table of a typical file */
+#define CNT_BIG_SYMBOLS 1024 /* symbols of the table of a large file */
+#define CNT_MACROS 8
+#define MAX_PATH 4096
+
+/* the compile state, defined by main.c in the assembler */
+per_thread int ic;
+per_thread int dc;
+per_thread int has_error;
+per_thread int cnt_line;
+per_thread char *file_am_name = "microbench";
+
+/* a benchmark runs cnt operations */
+typedef struct {
+    const char *name;
+    void (*run)(long cnt);
+} benchmark;
+
+/* lines of the parse and encode benchmarks */
+static char *lines[] = {
+    "L1: lea D4, @r1",
+    " mov @r4, @r3",
+    " .data -47, -76, 5, 1200",
+    "STR: .string \"abcdef\"",
+    " prn -5",
+    " jmp L1",
+    " cmp 3, D4",
+    " rts",
+    NULL
+};
+
+/* a line of a data table */
+static char data_line[] = "TABLE: .data 1024, -7, 2000, 45, -1800, 3, 17, 999, -2046, 60, 5, -12, 300, 81";
+
+/* a line of a message table */
+static char string_line[] = "MSG: .string \"Error: the value of the sensor is out of range, reset it\"";
+
+static node_ptr symbols = NULL, big_symbols = NULL, extern_list = NULL;
+static syntax_ast code_lines[8];
+static int cnt_code_lines;
+static Macro *macros = NULL;
+static am_output macro_out;
+static volatile long sink;   /* keeps the results alive */
+
+/*** functions prototypes ***/
+
+/* Fills a symbol table with cnt symbols */
+static void fill_symbols(node_ref head, int cnt);
+
+/* Adds a symbol to a table, the name is copied to a buffer of the size add_symbol expects */
+static void add_named_symbol(node_ref head, int address, char *name, symbol_type type);
+
+/* Prepares the inputs of the benchmarks, returns 0 on failure */
+static int setup();
+
+static void bench_parse(long cnt);
+static void bench_parse_data(long cnt);
+static void bench_parse_string(long cnt);
+static void bench_add_symbol(long cnt);
+static void bench_get_symbol(long cnt);
+static void bench_get_symbol_big(long cnt);
+static void bench_get_symbol_missing(long cnt);
+static void bench_encode(long cnt);
+static void bench_base_64(long cnt);
+static void bench_find_macro(long cnt);
+static void bench_find_macro_missing(long cnt);
+
+static benchmark benchmarks[] = {
+    {"syntax_ast_parse", bench_parse},
+    {"syntax_ast_parse/.data", bench_parse_data},
+    {"syntax_ast_parse/.string", bench_parse_string},
+    {"add_symbol", bench_add_symbol},
+    {"get_symbol", bench_get_symbol},
+    {"get_symbol/1024", bench_get_symbol_big},
+    {"get_symbol/missing", bench_get_symbol_missing},
+    {"encode_command+operands", bench_encode},
+    {"convert_to_base_64", bench_base_64},
+    {"find_macro", bench_find_macro},
+    {"find_macro/missing", bench_find_macro_missing},
+    {NULL, NULL}
+};
+
+
+int main(int argc, char *argv[]) {
+    struct timespec start, end;
+    benchmark *b;
+    long cnt, allocations;
+    double seconds;
+
+    if (!setup())
+        return 1;
+    printf("%-26s %12s %12s %14s\n", "benchmark", "ops", "ns/op", "allocs/op");
+    for (b = benchmarks; b->name != NULL; b++) {
+        if (argc > 1 && strncmp(b->name, argv[1], strlen(argv[1])) != 0)
+            continue;
+        for (cnt = 1000;; cnt *= 2) {
+            allocations = cnt_allocations;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            b->run(cnt);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+            if (seconds >= MIN_SECONDS)
+                break;
+        }
+        printf("%-26s %12ld %12.1f %14.2f\n", b->name, cnt, seconds * 1e9 / cnt,
+               (double)(cnt_allocations - allocations) / cnt);
+    }
+    clear_macro_list(&macros);
+    fclose(macro_out.fp);
+    return 0;
+}
+
+/* Fills a symbol table with cnt symbols */
+static void fill_symbols(node_ref head, int cnt) {
+    char name[MAX_SYMBOL_LENGTH];
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        sprintf(name, "SYMBOL%d", i);
+        add_symbol(head, INITIAL + i, name, i % 2 ? code_relocatable : data_relocatable);
+    }
+}
+
+/* Adds a symbol to a table, the name is copied to a buffer of the size add_symbol expects */
+static void add_named_symbol(node_ref head, int address, char *name, symbol_type type) {
+    char buffer[MAX_SYMBOL_LENGTH] = {0};
+
+    strcpy(buffer, name);
+    add_symbol(head, address, buffer, type);
+}
+
+/* Prepares the inputs of the benchmarks, returns 0 on failure */
+static int setup() {
+    char base[MAX_PATH], path[MAX_PATH + MAX_EXTENSION_LENGTH];
+    FILE *fp;
+    int i;
+
+    fill_symbols(&symbols, CNT_SYMBOLS);
+    fill_symbols(&big_symbols, CNT_BIG_SYMBOLS);
+    add_named_symbol(&symbols, INITIAL, "L1", code_relocatable);
+    add_named_symbol(&symbols, INITIAL + 10, "D4", data_relocatable);
+
+    for (i = 0; lines[i] != NULL; i++)
+        if (strstr(lines[i], " .") == NULL)
+            code_lines[cnt_code_lines++] = syntax_ast_parse(lines[i]);
+
+    /* the macros are read by the pre processor from a source file */
+    sprintf(base, "/tmp/microbench_%ld", (long)getpid());
+    sprintf(path, "%s%s", base, INPUT_FILE);
+    if ((fp = fopen(path, "w")) == NULL) {
+        printf("Error: can't create file: %s\n", path);
+        return 0;
+    }
+    for (i = 1; i <= CNT_MACROS; i++)
+        fprintf(fp, "mcro m%d\n inc @r%d\n mov @r%d, @r%d\nendmcro\n", i, i % 8, i % 8, (i + 1) % 8);
+    fclose(fp);
+    i = insert_macro(base, &macros);
+    remove(path);
+    if (i != 0 || macros == NULL) {
+        printf("Error: can't read the macros\n");
+        return 0;
+    }
+    macro_out.fp = fopen("/dev/null", "w");
+    macro_out.sink = NULL;
+    macro_out.arg = NULL;
+    return macro_out.fp != NULL;
+}
+
+/* one line of the fixed lines */
+static void bench_parse(long cnt) {
+    syntax_ast ast;
+    long i;
+
+    for (i = 0; i < cnt; i++) {
+        ast = syntax_ast_parse(lines[i % 8]);
+        sink += ast.opt_ast;
+    }
+}
+
+/* one .data line of 14 values, parsed and encoded */
+static void bench_parse_data(long cnt) {
+    static int data_code[MAX_CODE];
+    syntax_ast ast;
+    long i;
+
+    for (i = 0; i < cnt; i++) {
+        ast = syntax_ast_parse(data_line);
+        dc = 0;
+        encode_line_data(&ast, data_code);
+        sink += data_code[dc - 1];
+    }
+}
+
+/* one .string line of 56 chars, parsed and encoded */
+static void bench_parse_string(long cnt) {
+    static int data_code[MAX_CODE];
+    syntax_ast ast;
+    long i;
+
+    for (i = 0; i < cnt; i++) {
+        ast = syntax_ast_parse(string_line);
+        dc = 0;
+        encode_line_data(&ast, data_code);
+        sink += data_code[dc - 2];
+    }
+}
+
+/* one symbol inserted to a table of up to CNT_SYMBOLS symbols, with the duplicate check */
+static void bench_add_symbol(long cnt) {
+    node_ptr head = NULL;
+    char name[MAX_SYMBOL_LENGTH];
+    long i;
+
+    for (i = 0; i < cnt; i++) {
+        if (i % CNT_SYMBOLS == 0)
+            clear_list(&head);
+        sprintf(name, "SYMBOL%ld", i % CNT_SYMBOLS);
+        add_symbol(&head, INITIAL, name, code_relocatable);
+    }
+    clear_list(&head);
+}
+
+/* one lookup in the table of CNT_SYMBOLS symbols, every symbol in turn */
+static void bench_get_symbol(long cnt) {
+    char names[CNT_SYMBOLS][MAX_SYMBOL_LENGTH];
+    long i;
+
+    for (i = 0; i < CNT_SYMBOLS; i++)
+        sprintf(names[i], "SYMBOL%ld", i);
+    for (i = 0; i < cnt; i++)
+        sink += get_symbol(&symbols, names[i % CNT_SYMBOLS]) != NULL;
+}
+
+/* one lookup in the table of CNT_BIG_SYMBOLS symbols, every symbol in turn */
+static void bench_get_symbol_big(long cnt) {
+    static char names[CNT_BIG_SYMBOLS][MAX_SYMBOL_LENGTH];
+    long i;
+
+    for (i = 0; i < CNT_BIG_SYMBOLS; i++)
+        sprintf(names[i], "SYMBOL%ld", i);
+    for (i = 0; i < cnt; i++)
+        sink += get_symbol(&big_symbols, names[i % CNT_BIG_SYMBOLS]) != NULL;
+}
+
+/* one lookup of a name which isn't in the table of CNT_SYMBOLS symbols */
+static void bench_get_symbol_missing(long cnt) {
+    char name[MAX_SYMBOL_LENGTH] = "MISSING";
+    long i;
+
+    for (i = 0; i < cnt; i++)
+        sink += get_symbol(&symbols, name) != NULL;
+}
+
+/* the words of one instruction line */
+static void bench_encode(long cnt) {
+    int instruction[MAX_CODE];
+    long i;
+
+    for (i = 0; i < cnt; i++) {
+        ic = 0;
+        encode_command(code_lines[i % cnt_code_lines], instruction);
+        encode_operands(code_lines[i % cnt_code_lines], &symbols, &extern_list, instruction);
+        sink += instruction[0];
+    }
+}
+
+/* one word */
+static void bench_base_64(long cnt) {
+    char text[3];
+    long i;
+
+    for (i = 0; i < cnt; i++)
+        sink += convert_to_base_64((int)(i & 0xfff), text)[1];
+}
+
+/* one line which calls the last macro, its body is written to /dev/null */
+static void bench_find_macro(long cnt) {
+    char line[] = " m8\n";
+    long i;
+
+    for (i = 0; i < cnt; i++)
+        sink += find_macro(line, &macro_out, &macros);
+}
+
+/* one instruction line, which isn't a macro */
+static void bench_find_macro_missing(long cnt) {
+    char line[] = " mov @r4, @r3\n";
+    long i;
+
+    for (i = 0; i < cnt; i++)
+        sink += find_macro(line, &macro_out, &macros);
+}
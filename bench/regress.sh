@@ -0,0 +1,66 @@
+#!/bin/sh
+# regress.sh compiles the inputs of bench/regress in every mode and checks that the .am, .ob, .ent
+# and .ext files are byte-identical to the ones of the serial mode, then checks that --incremental
+# reuses the words of the unchanged instructions of incremental_reuse.as.
+# usage: regress.sh <assembler>
+# Exit status: 0 identical, 1 different.
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 <assembler>" >&2
+    exit 1
+fi
+bin=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+inputs=$(cd "$(dirname "$0")" && pwd)/regress
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/regress.XXXXXX") || exit 1
+trap 'rm -rf "$work"' EXIT
+
+different=0
+for src in "$inputs"/*.as; do
+    name=$(basename "$src" .as)
+    mkdir "$work/serial"
+    cp "$src" "$work/serial/"
+    (cd "$work/serial" && "$bin" "$name" > "$name.log" 2>&1)
+    for mode in --pipeline --parallel "--jobs 4" --incremental; do
+        dir="$work/mode"
+        mkdir "$dir"
+        cp "$src" "$dir/"
+        (cd "$dir" && "$bin" "$name" $mode > "$name.log" 2>&1)
+        for type in am ob ent ext; do
+            if [ -f "$work/serial/$name.$type" ] || [ -f "$dir/$name.$type" ]; then
+                if ! cmp -s "$work/serial/$name.$type" "$dir/$name.$type"; then
+                    echo "different: $name.$type with $mode"
+                    different=$((different + 1))
+                fi
+            fi
+        done
+        rm -rf "$dir"
+    done
+    rm -rf "$work/serial"
+done
+
+# an unchanged rerun encodes no instruction again, editing one immediate encodes only that one
+mkdir "$work/reuse"
+cp "$inputs/incremental_reuse.as" "$work/reuse/"
+cd "$work/reuse" || exit 1
+"$bin" incremental_reuse --incremental > /dev/null 2>&1
+reuse=$("$bin" incremental_reuse --incremental --stats 2>&1 | grep -m 1 "instructions reused")
+case "$reuse" in
+    *"reused 0,"*|"") echo "no instruction reused: $reuse"; different=$((different + 1)) ;;
+    *"encoded again 0") ;;
+    *) echo "instructions encoded again: $reuse"; different=$((different + 1)) ;;
+esac
+sed 's/prn -7/prn -8/' incremental_reuse.as > edited.as && mv edited.as incremental_reuse.as
+reuse=$("$bin" incremental_reuse --incremental --stats 2>&1 | grep -m 1 "instructions reused")
+case "$reuse" in
+    *"encoded again 1") ;;
+    *) echo "expected one instruction encoded again: $reuse"; different=$((different + 1)) ;;
+esac
+cd - > /dev/null
+
+if [ $different -ne 0 ]; then
+    echo "$different output files are different"
+    exit 1
+fi
+echo "all outputs are identical"
+exit 0
@@ -0,0 +1,12 @@
+; incremental regression: a rerun reuses the words of every instruction
+MAIN: mov @r3, LEN
+ add 4, @r1
+LOOP: prn -7
+ cmp LEN, 2
+ bne LOOP
+ lea STR, @r6
+ red @r2
+ rts
+ stop
+STR: .string "abcd"
+LEN: .data 6, -9, 15
@@ -0,0 +1,4 @@
+; the last line has no new line, its command has no operands
+MAIN: mov @r1, @r2
+ prn -5
+ rts
\ No newline at end of file
@@ -0,0 +1,154 @@
+/* run_bench.c runs the assembler over a corpus and reports the lines per second and the peak memory.
+ * usage: run_bench [-r runs] <assembler> <list> [assembler options]
+ * The list holds the base names of the sources, one per line, as written by gen_corpus.
+ * Every run compiles the whole corpus in one process, the best run and the largest peak are reported. */
+
+#define _DEFAULT_SOURCE    /* wait4 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_PATH 4096
+
+/*** functions prototypes ***/
+
+/* Reads the base names of the list into a NULL terminated array after the first slots, returns NULL on failure */
+static char **read_list(char *path, int first, long *cnt_files);
+
+/* Counts the lines of the source of a base name */
+static long count_lines(char *base_name);
+
+/* Runs the command once with its output in the log, returns its exit status or -1 */
+static int run_once(char **command, char *log, double *seconds, long *peak_kb);
+
+
+int main(int argc, char *argv[]) {
+    int runs = 3, arg = 1, cnt_options, i, status;
+    long cnt_files, lines = 0, peak_kb, max_peak_kb = 0, f;
+    double seconds, best = -1;
+    char **command, log[MAX_PATH];
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        runs = atoi(argv[2]);
+        arg = 3;
+    }
+    if (argc - arg < 2 || runs < 1) {
+        fprintf(stderr, "usage: %s [-r runs] <assembler> <list> [assembler options]\n", argv[0]);
+        return 1;
+    }
+
+    /* command: assembler, options, sources */
+    cnt_options = argc - arg - 2;
+    if ((command = read_list(argv[arg + 1], 1 + cnt_options, &cnt_files)) == NULL)
+        return 1;
+    command[0] = argv[arg];
+    for (i = 0; i < cnt_options; i++)
+        command[1 + i] = argv[arg + 2 + i];
+    for (f = 0; f < cnt_files; f++)
+        lines += count_lines(command[1 + cnt_options + f]);
+    sprintf(log, "%s.log", argv[arg + 1]);
+
+    printf("corpus: %ld files, %ld lines\n", cnt_files, lines);
+    for (i = 1; i <= runs; i++) {
+        if ((status = run_once(command, log, &seconds, &peak_kb)) != 0) {
+            fprintf(stderr, "Error: the assembler failed (status %d), see %s\n", status, log);
+            return 1;
+        }
+        printf("run %d: %.3f s, %.0f lines/s, peak RSS %ld KB\n", i, seconds, lines / seconds, peak_kb);
+        if (best < 0 || seconds < best)
+            best = seconds;
+        if (peak_kb > max_peak_kb)
+            max_peak_kb = peak_kb;
+    }
+    printf("best: %.3f s, %.0f lines/s, peak RSS %ld KB\n", best, lines / best, max_peak_kb);
+    return 0;
+}
+
+/* Reads the base names of the list into a NULL terminated array after the first slots, returns NULL on failure */
+static char **read_list(char *path, int first, long *cnt_files) {
+    FILE *in = fopen(path, "r");
+    char line[MAX_PATH], **names;
+    long size = 1024, len;
+
+    if (in == NULL) {
+        fprintf(stderr, "Error: can't open file: %s\n", path);
+        return NULL;
+    }
+    names = (char **)malloc((first + size + 1) * sizeof(char *));
+    *cnt_files = 0;
+    while (names != NULL && fgets(line, MAX_PATH, in) != NULL) {
+        len = (long)strcspn(line, "\r\n");
+        if (len == 0)
+            continue;
+        line[len] = '\0';
+        if (*cnt_files == size) {
+            size *= 2;
+            names = (char **)realloc(names, (first + size + 1) * sizeof(char *));
+            if (names == NULL)
+                break;
+        }
+        if ((names[first + (*cnt_files)++] = strdup(line)) == NULL) {
+            free(names);
+            names = NULL;
+        }
+    }
+    fclose(in);
+    if (names == NULL) {
+        fprintf(stderr, "Cannot allocate memory for this operation.\n");
+        return NULL;
+    }
+    names[first + *cnt_files] = NULL;
+    return names;
+}
+
+/* Counts the lines of the source of a base name */
+static long count_lines(char *base_name) {
+    char path[MAX_PATH];
+    long lines = 0;
+    int c;
+    FILE *in;
+
+    sprintf(path, "%s.as", base_name);
+    if ((in = fopen(path, "r")) == NULL)
+        return 0;
+    while ((c = getc(in)) != EOF)
+        if (c == '\n')
+            lines++;
+    fclose(in);
+    return lines;
+}
+
+/* Runs the command once with its output in the log, returns its exit status or -1 */
+static int run_once(char **command, char *log, double *seconds, long *peak_kb) {
+    struct timespec start, end;
+    struct rusage usage;
+    int status, fd;
+    pid_t pid;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((pid = fork()) < 0)
+        return -1;
+    if (pid == 0) {
+        if ((fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(command[0], command);
+        _exit(127);
+    }
+    if (wait4(pid, &status, 0, &usage) < 0)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    *peak_kb = usage.ru_maxrss;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
@@ -0,0 +1,395 @@
+/*** cache.c keeps the outputs of every source in a directory, the oldest are evicted ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <utime.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "define.h"
+#include "options.h"
+#include "diag.h"
+#include "cache.h"
+#include "stream.h"
+#include "async_io.h"
+#include "stats.h"
+#include "emit.h"
+
+#define CACHE_FORMAT "asm-cache 1"
+#define ENTRY_SUFFIX ".entry"
+#define MEGABYTE (1024L * 1024L)
+
+/* The build time of cache.o is part of the key, the makefile rebuilds it with any source */
+#define BUILD_ID __DATE__ " " __TIME__
+
+#define MAX_OUTPUTS 16   /* output files of a source, the .am and the ones of the emitters */
+
+/* an entry of the cache directory, for the eviction */
+typedef struct {
+    char *path;
+    long size;
+    time_t used;           /* last hit or store */
+} cache_file;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static char **written = NULL;      /* output files written since they were stored */
+static int cnt_written = 0, size_written = 0;
+static long cache_total = -1;      /* bytes in the cache directory, -1 before the first scan */
+
+/*** functions prototypes ***/
+
+/* Computes the key of the source, returns 0 if it can't be read */
+static int source_key(char *file_name, char key[]);
+
+/* Reads a whole file, returns NULL if it can't be read */
+static char *read_file(char *path, long *len);
+
+/* Returns the path of the entry of the key */
+static char *entry_path(char key[]);
+
+/* Removes the file from the written list, returns 1 if it was there */
+static int take_written(char *path);
+
+/* Returns the name of the temporary file of an output, unique to the process and the thread */
+static char *temp_name(char *name);
+
+/* Checks if the outputs are written by the I/O backend, the cache needs them on disk at once */
+static int async_writes();
+
+/* Evicts the least recently used entries until the cache is below its size */
+static void trim_cache(long limit);
+
+/* Orders the entries by their last use, the oldest first */
+static int by_use(const void *a, const void *b);
+
+
+/* Restores the outputs of the file from the cache and prints its diagnostics, returns 1 on a hit */
+int cache_restore(char *file_name, char key[]) {
+    char *path, *entry, *p, *end, *out_name, type[MAX_EXTENSION_LENGTH + 1];
+    long len, section;
+    FILE *fp;
+
+    key[0] = '\0';
+    if (options.cache_dir == NULL || !source_key(file_name, key))
+        return 0;
+
+    path = entry_path(key);
+    entry = read_file(path, &len);
+    if (entry == NULL || strncmp(entry, CACHE_FORMAT "\n", strlen(CACHE_FORMAT) + 1) != 0) {
+        asm_free(entry);
+        asm_free(path);
+        return 0;
+    }
+    /* The entry is used now, the eviction goes by the time of the file */
+    utime(path, NULL);
+    asm_free(path);
+
+    /* The sections: "<type> <length>\n" and the bytes, the diagnostics are of type "diag" */
+    p = entry + strlen(CACHE_FORMAT) + 1;
+    end = entry + len;
+    while (p < end && sscanf(p, "%5s %ld", type, &section) == 2) {
+        p = strchr(p, '\n') + 1;
+        if (section < 0 || section > end - p)
+            break;
+        if (strcmp(type, "diag") == 0) {
+            diag_printf("%.*s", (int)section, p);
+        } else {
+            out_name = output_name(file_name, type);
+            if ((fp = open_output(out_name)) != NULL) {
+                fwrite(p, 1, section, fp);
+                if (close_output(fp, out_name))
+                    take_written(out_name);
+            }
+            asm_free(out_name);
+        }
+        p += section;
+    }
+    asm_free(entry);
+    /* Nothing to store */
+    key[0] = '\0';
+    return 1;
+}
+
+/* Stores the outputs the file wrote and its diagnostics, nothing if the key is empty */
+void cache_store(char *file_name, char key[], diag_buffer *diag) {
+    char *path, *tmp_path, *out_name, *text;
+    const char *types[MAX_OUTPUTS];
+    long len, total = 0;
+    FILE *fp;
+    int i, cnt;
+
+    if (key[0] == '\0')
+        return;
+    path = entry_path(key);
+    tmp_path = (char *)asm_malloc(strlen(path) + 32);
+    valid_allocate(tmp_path);
+    sprintf(tmp_path, "%s.%ld.tmp", path, (long)getpid());
+    fp = fopen(tmp_path, "w");
+
+    if (fp != NULL) {
+        fprintf(fp, "%s\n", CACHE_FORMAT);
+        if (diag != NULL && diag->len > 0) {
+            fprintf(fp, "diag %ld\n", diag->len);
+            fwrite(diag->text, 1, diag->len, fp);
+        }
+    }
+    /* the files a source may write: the .am and the output of every emitter which is on */
+    types[0] = MACRO_FILE;
+    cnt = 1 + emit_types(types + 1, MAX_OUTPUTS - 1);
+    for (i = 0; i < cnt; i++) {
+        /* A file which this run didn't write is an output of an older source */
+        out_name = output_name(file_name, (char *)types[i]);
+        if (take_written(out_name) && fp != NULL && (text = read_file(out_name, &len)) != NULL) {
+            fprintf(fp, "%s %ld\n", types[i], len);
+            fwrite(text, 1, len, fp);
+            asm_free(text);
+        }
+        asm_free(out_name);
+    }
+    if (fp != NULL) {
+        total = ftell(fp);
+        /* Readers see the whole entry or none */
+        if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+            remove(tmp_path);
+    }
+    asm_free(tmp_path);
+    asm_free(path);
+
+    pthread_mutex_lock(&cache_lock);
+    if (cache_total >= 0)
+        cache_total += total;
+    trim_cache((options.cache_size > 0 ? options.cache_size : CACHE_DEFAULT_SIZE) * MEGABYTE);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/* Opens an output file for writing, into a temporary file which close_output puts in place */
+FILE *open_output(char *name) {
+    char *tmp_name;
+    FILE *fp;
+
+    if (streaming())
+        return stream_open(name);
+    if (async_writes())
+        return async_open_write(name);
+    tmp_name = temp_name(name);
+    fp = fopen(tmp_name, "w");
+    asm_free(tmp_name);
+    return fp;
+}
+
+/* Closes an output file without putting it in place, the old file stays */
+void discard_output(FILE *fp, char *name) {
+    char *tmp_name;
+
+    if (streaming()) {
+        stream_discard(fp, name);
+        return;
+    }
+    if (async_writes()) {
+        async_discard(fp);
+        return;
+    }
+    tmp_name = temp_name(name);
+    fclose(fp);
+    remove(tmp_name);
+    asm_free(tmp_name);
+}
+
+/* Closes an output file and puts it in place, returns 0 on failure */
+int close_output(FILE *fp, char *name) {
+    char *tmp_name;
+    int ok;
+
+    stats_count(stat_bytes_written, ftell(fp));
+    if (streaming())
+        return stream_close(fp, name);
+    if (async_writes())
+        return async_close_write(fp);
+    tmp_name = temp_name(name);
+    ok = fclose(fp) == 0 && rename(tmp_name, name) == 0;
+    if (!ok)
+        remove(tmp_name);
+    asm_free(tmp_name);
+    if (!ok || options.cache_dir == NULL)
+        return ok;
+
+    /* The cache keeps the files written, until the source stores them */
+    pthread_mutex_lock(&cache_lock);
+    if (cnt_written == size_written) {
+        size_written = size_written == 0 ? 16 : size_written * 2;
+        written = (char **)asm_realloc(written, size_written * sizeof(char *));
+        valid_allocate(written);
+    }
+    written[cnt_written] = (char *)asm_malloc(strlen(name) + 1);
+    valid_allocate(written[cnt_written]);
+    strcpy(written[cnt_written++], name);
+    pthread_mutex_unlock(&cache_lock);
+    return ok;
+}
+
+/* Returns the name of the temporary file of an output, unique to the process and the thread */
+static char *temp_name(char *name) {
+    static int cnt_threads = 0;
+    static per_thread int thread_tag = 0;
+    char *tmp_name = (char *)asm_malloc(strlen(name) + 48);
+
+    valid_allocate(tmp_name);
+    if (thread_tag == 0)
+        thread_tag = __atomic_add_fetch(&cnt_threads, 1, __ATOMIC_RELAXED);
+    sprintf(tmp_name, "%s.%ld.%d.tmp", name, (long)getpid(), thread_tag);
+    return tmp_name;
+}
+
+/* Computes the key of the source, returns 0 if it can't be read */
+static int source_key(char *file_name, char key[]) {
+    char *asfile_name = name_file(file_name, INPUT_FILE), *text;
+    char config[128];
+    unsigned long h[2] = {2166136261UL, 5381UL};
+    long len;
+
+    text = read_file(asfile_name, &len);
+    asm_free(asfile_name);
+    if (text == NULL)
+        return 0;
+
+    /* The modes of compiling don't change the output, only the build, the modes of build_id and
+     * the choice of the output files do */
+    sprintf(config, "%s|%s|%d|", CACHE_FORMAT, build_id(), options.binary ? 1 : 0);
+    hash_text(config, strlen(config), h);
+    if (options.emit != NULL)
+        hash_text(options.emit, strlen(options.emit), h);
+    hash_text(text, len, h);
+    asm_free(text);
+    sprintf(key, "%08lx%08lx%lx", h[0], h[1], len & 0xffffffUL);
+    return 1;
+}
+
+/* Identifies the build of the assembler and the modes which change the outputs (L for --long-lines,
+ * D for --dedup-data, P for --peephole), state saved by another build or mode is not used */
+const char *build_id() {
+    static const char *ids[] = {BUILD_ID, BUILD_ID " L", BUILD_ID " D", BUILD_ID " LD",
+                                BUILD_ID " P", BUILD_ID " LP", BUILD_ID " DP", BUILD_ID " LDP"};
+
+    return ids[(options.long_lines ? 1 : 0) + (options.dedup_data ? 2 : 0) + (options.peephole ? 4 : 0)];
+}
+
+/* Hashes the text into the two 32-bit hash values (FNV-1a and djb2), h holds the start values */
+void hash_text(const char *text, long len, unsigned long h[2]) {
+    long i;
+    for (i = 0; i < len; i++) {
+        h[0] = ((h[0] ^ (unsigned char)text[i]) * 16777619UL) & 0xffffffffUL;
+        h[1] = (h[1] * 33 + (unsigned char)text[i]) & 0xffffffffUL;
+    }
+}
+
+/* Reads a whole file, returns NULL if it can't be read */
+static char *read_file(char *path, long *len) {
+    FILE *fp = fopen(path, "rb");
+    char *text;
+
+    if (fp == NULL)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    rewind(fp);
+    text = (char *)asm_malloc(*len + 1);
+    valid_allocate(text);
+    if (*len < 0 || (long)fread(text, 1, *len, fp) != *len) {
+        asm_free(text);
+        fclose(fp);
+        return NULL;
+    }
+    text[*len] = '\0';
+    fclose(fp);
+    return text;
+}
+
+/* Returns the path of the entry of the key */
+static char *entry_path(char key[]) {
+    char *path = (char *)asm_malloc(strlen(options.cache_dir) + CACHE_KEY_SIZE + strlen(ENTRY_SUFFIX) + 2);
+    valid_allocate(path);
+    mkdir(options.cache_dir, 0777); /* nothing if it exists */
+    sprintf(path, "%s/%s%s", options.cache_dir, key, ENTRY_SUFFIX);
+    return path;
+}
+
+/* Removes the file from the written list, returns 1 if it was there */
+static int take_written(char *path) {
+    int i, found = 0;
+
+    pthread_mutex_lock(&cache_lock);
+    for (i = 0; i < cnt_written; i++) {
+        if (strcmp(written[i], path) == 0) {
+            asm_free(written[i]);
+            written[i] = written[--cnt_written];
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return found;
+}
+
+/* Evicts the least recently used entries until the cache is below its size, called with the lock held */
+static void trim_cache(long limit) {
+    DIR *dir;
+    struct dirent *ent;
+    struct stat st;
+    cache_file *files = NULL;
+    int cnt = 0, size = 0, i;
+    long suffix_len = strlen(ENTRY_SUFFIX), name_len;
+    char *path;
+
+    /* The directory is scanned once, and again only when it is full */
+    if (cache_total >= 0 && cache_total <= limit)
+        return;
+    if ((dir = opendir(options.cache_dir)) == NULL)
+        return;
+    cache_total = 0;
+    while ((ent = readdir(dir)) != NULL) {
+        name_len = strlen(ent->d_name);
+        if (name_len <= suffix_len || strcmp(ent->d_name + name_len - suffix_len, ENTRY_SUFFIX) != 0)
+            continue;
+        path = (char *)asm_malloc(strlen(options.cache_dir) + name_len + 2);
+        valid_allocate(path);
+        sprintf(path, "%s/%s", options.cache_dir, ent->d_name);
+        if (stat(path, &st) != 0) {
+            asm_free(path);
+            continue;
+        }
+        if (cnt == size) {
+            size = size == 0 ? 64 : size * 2;
+            files = (cache_file *)asm_realloc(files, size * sizeof(cache_file));
+            valid_allocate(files);
+        }
+        files[cnt].path = path;
+        files[cnt].size = (long)st.st_size;
+        files[cnt].used = st.st_mtime;
+        cache_total += files[cnt++].size;
+    }
+    closedir(dir);
+
+    /* Evict to three quarters of the limit, so the next stores don't scan again */
+    if (cache_total > limit) {
+        qsort(files, cnt, sizeof(cache_file), by_use);
+        for (i = 0; i < cnt && cache_total > limit / 4 * 3; i++) {
+            if (remove(files[i].path) == 0)
+                cache_total -= files[i].size;
+        }
+    }
+    for (i = 0; i < cnt; i++)
+        asm_free(files[i].path);
+    asm_free(files);
+}
+
+/* Orders the entries by their last use, the oldest first */
+static int by_use(const void *a, const void *b) {
+    time_t used_a = ((cache_file *)a)->used, used_b = ((cache_file *)b)->used;
+    return used_a < used_b ? -1 : used_a > used_b ? 1 : 0;
+}
+
+/* Checks if the outputs are written by the I/O backend, the cache needs them on disk at once */
+static int async_writes() {
+    return async_active() && options.cache_dir == NULL;
+}
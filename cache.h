@@ -0,0 +1,40 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stdio.h>
+#include "diag.h"
+
+/* The output cache keeps the output files and the diagnostics of every source it saw,
+ * keyed by a hash of the source, the assembler build and the options which change
+ * the output. A source which didn't change is restored from the cache without
+ * being compiled. The cache is on when options.cache_dir is set. */
+
+#define CACHE_KEY_SIZE 32          /* size of a key, in chars */
+#define CACHE_DEFAULT_SIZE 64      /* size limit of the cache, in megabytes */
+
+/* Restores the outputs of the file from the cache and prints its diagnostics, returns 1 on a hit.
+ * On a miss key receives the key cache_store should use, empty when the cache is off */
+int cache_restore(char *file_name, char key[]);
+
+/* Stores the outputs the file wrote and its diagnostics, nothing if the key is empty */
+void cache_store(char *file_name, char key[], diag_buffer *diag);
+
+/* Opens an output file for writing. The text goes to a temporary file which
+ * close_output renames over the old file, so readers never see half a file */
+FILE *open_output(char *name);
+
+/* Closes an output file without putting it in place, the old file stays */
+void discard_output(FILE *fp, char *name);
+
+/* Closes an output file and puts it in place, returns 0 on failure.
+ * The cache keeps the names of the files written */
+int close_output(FILE *fp, char *name);
+
+/* Identifies the build of the assembler and the modes which change the outputs (--long-lines, --dedup-data
+ * and --peephole), state saved by another build or mode is not used */
+const char *build_id();
+
+/* Hashes the text into the two 32-bit hash values (FNV-1a and djb2), h holds the start values */
+void hash_text(const char *text, long len, unsigned long h[2]);
+
+#endif
@@ -0,0 +1,98 @@
+/* client.c sends its command line to an assembler server and prints the answer.
+ * It takes the same arguments as the assembler, so it can replace it in makefiles.
+ * The socket is given by --socket <path> or by the ASSEMBLER_SOCKET variable. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_PATH 4096
+
+/*** functions prototypes ***/
+
+/* Connects to the server, returns -1 on failure */
+static int connect_server(char *socket_path);
+
+/* Writes all the text to the socket, returns 0 on failure */
+static int send_text(int fd, char *text);
+
+
+int main(int argc, char *argv[]) {
+    char *socket_path = getenv("ASSEMBLER_SOCKET");
+    char cwd[MAX_PATH], buffer[MAX_PATH + 8];
+    int fd, i = 1, status = 1, n;
+    long len = 0;
+    FILE *in;
+
+    if (argc > 2 && strcmp(argv[1], "--socket") == 0) {
+        socket_path = argv[2];
+        i = 3;
+    }
+    if (socket_path == NULL) {
+        printf("Error: no server socket, use --socket or ASSEMBLER_SOCKET\n");
+        return 1;
+    }
+    if ((fd = connect_server(socket_path)) < 0) {
+        printf("Error: can't connect to the assembler server at %s\n", socket_path);
+        return 1;
+    }
+
+    /* The request: the directory and the command line */
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+        strcpy(cwd, ".");
+    sprintf(buffer, "cwd %s\n", cwd);
+    send_text(fd, buffer);
+    for (; i < argc; i++) {
+        send_text(fd, "arg ");
+        send_text(fd, argv[i]);
+        send_text(fd, "\n");
+    }
+    send_text(fd, "end\n");
+    shutdown(fd, SHUT_WR);
+
+    /* The answer: the status and the diagnostics */
+    in = fdopen(fd, "r");
+    if (in == NULL || fscanf(in, "status %d\ndiag %ld", &status, &len) != 2 || fgetc(in) != '\n') {
+        printf("Error: bad answer from the assembler server\n");
+        return 1;
+    }
+    while (len > 0 && (n = fread(buffer, 1, len < (long)sizeof(buffer) ? len : (long)sizeof(buffer), in)) > 0) {
+        fwrite(buffer, 1, n, stdout);
+        len -= n;
+    }
+    fclose(in);
+    return status;
+}
+
+/* Connects to the server, returns -1 on failure */
+static int connect_server(char *socket_path) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return -1;
+    return fd;
+}
+
+/* Writes all the text to the socket, returns 0 on failure */
+static int send_text(int fd, char *text) {
+    long len = strlen(text), n;
+
+    while (len > 0) {
+        if ((n = write(fd, text, len)) <= 0)
+            return 0;
+        text += n;
+        len -= n;
+    }
+    return 1;
+}
@@ -1,14 +1,14 @@
 #include "compile.h"
 #include "define.h"
+#include "options.h"
+#include "stream.h"
+#include "stats.h"
 
-extern int cnt_line;	/* line number to show in errors */
-extern bool has_error;	/* to prevent output file creation if an error was found */
-extern int ic;  
-extern int dc;
-extern char *file_am_name;
-
-/* reset global vars and code_arrays*/
-void initialize_vars(int instruction[], int data_code[]);
+extern per_thread int cnt_line;	/* line number to show in errors */
+extern per_thread bool has_error;	/* to prevent output file creation if an error was found */
+extern per_thread int ic;  
+extern per_thread int dc;
+extern per_thread char *file_am_name;
 
 /* compiles the am_file */
 void compile(char *file_name) {
@@ -18,15 +18,16 @@ void compile(char *file_name) {
     int instruction[MAX_CODE];
     int data_code[MAX_CODE];
     node_ptr symbol_head = NULL; 
+    stats_state prev = stats_enter(file_name, phase_first_iteration);
     
     /* Generate the name of the macro file */
-    amfile_name = name_file(file_name, MACRO_FILE);
+    amfile_name = output_name(file_name, MACRO_FILE);
     /* Open the macro file for reading */
-    fp = fopen(amfile_name, "r");
+    fp = open_input(amfile_name);
     if (!fp) {
-        printf("Error: couldn't open file");
-        free(amfile_name);
-        exit(1);
+        diag_printf("Error: couldn't open file");
+        asm_free(amfile_name);
+        fatal_error();
     } else {
         /* Initialize instruction and data_code arrays */
         initialize_vars(instruction, data_code);
@@ -46,9 +47,10 @@ void compile(char *file_name) {
          
     }
     fclose(fp);
-    free(amfile_name);
+    asm_free(amfile_name);
     /* Clear the linked list of symbols and free memory */
     clear_list(&symbol_head); 
+    stats_leave(prev);
 }
 
 /* reset global vars and code_arrays*/
@@ -70,7 +72,7 @@ void initialize_vars(int instruction[], int data_code[]){
 /*generates name file according to the type*/
 char *name_file(char *original, char *type)
 {
-    char *modified = (char *) malloc(strlen(original) + MAX_EXTENSION_LENGTH);
+    char *modified = (char *) asm_malloc(strlen(original) + MAX_EXTENSION_LENGTH);
  valid_allocate(modified);
 
     strcpy(modified, original); /* Copying original filename to the bigger string */
@@ -81,6 +83,23 @@ char *name_file(char *original, char *type)
     return modified;
 }
 
+/*generates the name of an output file, in the output directory if one was given*/
+char *output_name(char *original, char *type)
+{
+    char *modified, *base;
+
+    if (options.out_dir == NULL)
+        return name_file(original, type);
+
+    /* The output keeps the base name of the input */
+    base = strrchr(original, '/');
+    base = base == NULL ? original : base + 1;
+    modified = (char *) asm_malloc(strlen(options.out_dir) + strlen(base) + MAX_EXTENSION_LENGTH + 1);
+    valid_allocate(modified);
+    sprintf(modified, "%s/%s%s", options.out_dir, base, type);
+    return modified;
+}
+
 /*check for comment or empty line*/
 int comment_empty_line(char* line_buffer){
 	erase_spaces(line_buffer)
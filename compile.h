@@ -9,6 +9,7 @@
 
 #include "symbol_table.h"
 #include "syntax.h"
+#include "diag.h"
 
 /* compiles the am_file */
 void compile (char * file_name);
@@ -16,9 +17,46 @@ void compile (char * file_name);
 /* coding data code and build symbol table*/
 void first_iteration(FILE *am_file, node_ptr *label_head ,int []);
 
+/* Build the symbol table based on the provided line_ast, update data_code if needed */
+void build_symbol_table(syntax_ast line_ast, node_ref symbol_head, int data_code[]);
+
+/* Add the symbols the line defines at the current ic/dc, returns 0 if the line has an error */
+int add_line_symbols(syntax_ast *line_ast, node_ref symbol_head);
+
+/* Count the instruction words and the data words of the line */
+void line_words(syntax_ast *line_ast, int *code_words, int *data_words);
+
+/* Encode the data of a .data or .string line at the current dc */
+void encode_line_data(syntax_ast *line_ast, int data_code[]);
+
+/* Check the memory limits and move the data symbols after the code, with --dedup-data the
+ * identical data blocks are pooled first and dc becomes the size of the pooled segment */
+void finish_first_iteration(node_ref symbol_head, int data_code[]);
+
+/* Report a line which is longer than the allowed length */
+void long_line_error();
+
 /*ecoding the instructions sentences according to symbol table an creates output files */
 void second_iteration(char *, FILE *, node_ref , int  [], int  []);
 
+/* Encode a single parsed line of the second iteration */
+void second_iteration_line(syntax_ast *line_ast, node_ref symbol_head, node_ref extern_list, node_ref entry_list, int instruction[]);
+
+/* Encode the command portion of an assembly line */
+void encode_command(syntax_ast ast, int instruction[]);
+
+/* Encode the operands of an assembly line */
+void encode_operands(syntax_ast ast, node_ref symbol_head, node_ref extern_list, int instruction[]);
+
+/* Add an entry symbol to the entry list */
+void add_entry(char symbol[], node_ref symbol_head, node_ref entry_list);
+
+/* Create the output files if no errors were encountered */
+void create_output_files(char *file_name, int instruction[], int data_code[], node_ref entry_list, node_ref extern_list);
+
+/* reset global vars and code_arrays*/
+void initialize_vars(int instruction[], int data_code[]);
+
 /*check for comment or empty line*/
 int comment_empty_line(char* line_buffer);
 
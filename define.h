@@ -31,11 +31,20 @@
 #define OBJECT_FILE ".ob" 
 #define EXTERN_FILE ".ext"
 #define ENTRIES_FILE ".ent"
+#define STATE_FILE ".inc"
+#define BINARY_FILE ".obj"
 
 #include <ctype.h>
+#include "alloc.h"
 /* Macros */
-#define free_s(p) if(p!= NULL) free(p); p = NULL;
-#define valid_allocate(buffer) if (#buffer == NULL) {printf("Cannot allocate memory for this operation.\n"); exit(1); }
+#define free_s(p) if(p!= NULL) asm_free(p); p = NULL;
+#define valid_allocate(buffer) if ((buffer) == NULL) {printf("Cannot allocate memory for this operation.\n"); exit(1); }
+
+/* The compile state (ic, dc, cnt_line, has_error, file_am_name) is kept per thread, so several threads can compile at once */
+#define per_thread __thread
+
+/* allocations of this thread, counted by alloc.c for --stats */
+extern per_thread long cnt_allocations;
 
 /* Represents a boolean */
 
@@ -47,4 +56,7 @@ typedef enum  {
 /*generates name file according to the type*/
 char *name_file(char *original, char *type);
 
+/*generates the name of an output file, in the output directory if one was given*/
+char *output_name(char *original, char *type);
+
 #endif
@@ -0,0 +1,137 @@
+/* diag.c prints the diagnostics, or collects them in a per thread buffer */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "diag.h"
+#include "define.h"
+#include "probes.h"
+
+extern per_thread int cnt_line;	/* line number to show in errors */
+
+static per_thread diag_buffer *current = NULL; /* where this thread's diagnostics go, NULL for stdout */
+static per_thread jmp_buf *fatal_target = NULL; /* where fatal_error jumps to, NULL to exit */
+
+/*** functions prototypes ***/
+
+/* Sends a message of the given line to the current destination */
+static void diag_write(int line, const char *text, long len);
+
+
+/* Prints a diagnostic message, like printf */
+void diag_printf(const char *format, ...) {
+    va_list args;
+    char small[256];
+    char *text = small;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+
+    /* Long messages are formatted again into a buffer of the right size */
+    if (len >= (int)sizeof(small)) {
+        text = (char *)asm_malloc(len + 1);
+        valid_allocate(text);
+        va_start(args, format);
+        vsnprintf(text, len + 1, format, args);
+        va_end(args);
+    }
+    probe2(diag, cnt_line, text);
+    diag_write(cnt_line, text, len);
+    if (text != small)
+        asm_free(text);
+}
+
+/* Sends the diagnostics of this thread to buf (NULL for stdout), returns the previous buffer */
+diag_buffer *diag_redirect(diag_buffer *buf) {
+    diag_buffer *prev = current;
+    current = buf;
+    return prev;
+}
+
+/* The buffer the diagnostics of this thread go to, NULL for stdout */
+diag_buffer *diag_current() {
+    return current;
+}
+
+/* Ends the compilation after an error it can't go on from */
+void fatal_error() {
+    if (fatal_target != NULL)
+        longjmp(*fatal_target, 1);
+    exit(1);
+}
+
+/* Sets the target fatal_error jumps to on this thread (NULL to exit), returns the previous target */
+jmp_buf *catch_fatal(jmp_buf *target) {
+    jmp_buf *prev = fatal_target;
+    fatal_target = target;
+    return prev;
+}
+
+/* Sends a message of the given line to the current destination */
+static void diag_write(int line, const char *text, long len) {
+    diag_buffer *buf = current;
+
+    if (buf == NULL) {
+        fwrite(text, 1, len, stdout);
+        return;
+    }
+    if (buf->len + len + 1 > buf->size) {
+        buf->size = (buf->len + len + 1) * 2;
+        buf->text = (char *)asm_realloc(buf->text, buf->size);
+        valid_allocate(buf->text);
+    }
+    if (buf->cnt_marks == buf->size_marks) {
+        buf->size_marks = buf->size_marks ? buf->size_marks * 2 : 16;
+        buf->marks = (diag_mark *)asm_realloc(buf->marks, buf->size_marks * sizeof(diag_mark));
+        valid_allocate(buf->marks);
+    }
+    buf->marks[buf->cnt_marks].line = line;
+    buf->marks[buf->cnt_marks].offset = buf->len;
+    buf->cnt_marks++;
+    memcpy(buf->text + buf->len, text, len);
+    buf->len += len;
+    buf->text[buf->len] = '\0';
+}
+
+/* Prints the messages of all buffers ordered by line, messages of the same line keep the buffers order */
+void diag_merge(diag_buffer bufs[], int cnt) {
+    int *next, i, best;
+    long end;
+    diag_buffer *buf;
+
+    next = (int *)asm_calloc(cnt + 1, sizeof(int));
+    valid_allocate(next);
+    for (;;) {
+        /* The buffer with the lowest line, the messages of every buffer are in line order */
+        best = -1;
+        for (i = 0; i < cnt; i++) {
+            if (next[i] < bufs[i].cnt_marks &&
+                (best == -1 || bufs[i].marks[next[i]].line < bufs[best].marks[next[best]].line))
+                best = i;
+        }
+        if (best == -1)
+            break;
+        buf = &bufs[best];
+        end = next[best] + 1 < buf->cnt_marks ? buf->marks[next[best] + 1].offset : buf->len;
+        diag_write(buf->marks[next[best]].line, buf->text + buf->marks[next[best]].offset,
+                   end - buf->marks[next[best]].offset);
+        next[best]++;
+    }
+    asm_free(next);
+}
+
+/* Prints the messages of the buffer */
+void diag_flush(diag_buffer *buf) {
+    diag_merge(buf, 1);
+    diag_clear(buf);
+}
+
+/* Frees the messages of the buffer */
+void diag_clear(diag_buffer *buf) {
+    asm_free(buf->text);
+    asm_free(buf->marks);
+    memset(buf, 0, sizeof(diag_buffer));
+}
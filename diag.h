@@ -0,0 +1,48 @@
+#ifndef _DIAG_H_
+#define _DIAG_H_
+
+#include <setjmp.h>
+
+/* Diagnostics (errors and warnings about the source) are printed with diag_printf.
+ * By default they go to stdout, a thread may collect them in a buffer instead,
+ * every message is marked with the line it was printed for. */
+
+/* a message in a buffer */
+typedef struct {
+    int line;          /* value of cnt_line when the message was printed */
+    long offset;       /* start of the message in text */
+} diag_mark;
+
+typedef struct {
+    char *text;        /* all the messages, one after the other */
+    long len, size;
+    diag_mark *marks;
+    int cnt_marks, size_marks;
+} diag_buffer;
+
+/* Prints a diagnostic message, like printf */
+void diag_printf(const char *format, ...);
+
+/* Sends the diagnostics of this thread to buf (NULL for stdout), returns the previous buffer */
+diag_buffer *diag_redirect(diag_buffer *buf);
+
+/* The buffer the diagnostics of this thread go to, NULL for stdout */
+diag_buffer *diag_current();
+
+/* Ends the compilation after an error it can't go on from: jumps to the target set by
+ * catch_fatal on this thread, or exits if there is none */
+void fatal_error();
+
+/* Sets the target fatal_error jumps to on this thread (NULL to exit), returns the previous target */
+jmp_buf *catch_fatal(jmp_buf *target);
+
+/* Prints the messages of all buffers ordered by line, messages of the same line keep the buffers order */
+void diag_merge(diag_buffer bufs[], int cnt);
+
+/* Prints the messages of the buffer */
+void diag_flush(diag_buffer *buf);
+
+/* Frees the messages of the buffer */
+void diag_clear(diag_buffer *buf);
+
+#endif
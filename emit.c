@@ -0,0 +1,385 @@
+/*** emit.c writes the output files of an assembled image, in every format which is on ***/
+#include <stdlib.h>
+#include <string.h>
+#include "define.h"
+#include "options.h"
+#include "diag.h"
+#include "cache.h"
+#include "objfile.h"
+#include "emit.h"
+
+#define DEFAULT_EMIT "ob,ent,ext"
+#define HEX_RECORD 16           /* data bytes in an Intel HEX record */
+
+static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*** functions prototypes ***/
+
+/* Extract specific bits from an unsigned integer */
+static unsigned int extract_bits(unsigned int number, int startBit, int numBits);
+
+/* Checks if an output is in the list of the options */
+static int emitter_on(const emitter *em);
+
+/* Checks if a name is in a list separated by commas */
+static int in_list(const char *list, const char *name);
+
+/* Copies a symbol list to a table of the binary object file, cnt receives its length */
+static obj_symbol *symbol_table_of(node_ref list, int *cnt);
+
+/* The .ob file: ic and dc, and a word in base 64 on every line */
+static void ob_begin(emit_output *out);
+static void ob_word(emit_output *out, segment_kind segment, int address, int word);
+
+/* The .ent and .ext files: a symbol and its address on every line */
+static int has_entries(asm_image *image);
+static int has_externs(asm_image *image);
+static void symbol_line(emit_output *out, char *name, int address);
+
+/* The .obj file, see objfile.h */
+static void obj_end(emit_output *out);
+
+/* The .bin file: the memory from the first address, a word in 2 bytes, little endian */
+static void bin_word(emit_output *out, segment_kind segment, int address, int word);
+
+/* The .hex file: the memory in Intel HEX records, a word in 2 bytes, little endian */
+static void hex_begin(emit_output *out);
+static void hex_word(emit_output *out, segment_kind segment, int address, int word);
+static void hex_flush(emit_output *out);
+static void hex_end(emit_output *out);
+
+/* The .lst file: every word with its address, bits, base 64 and A,R,E, then the symbols */
+static void lst_begin(emit_output *out);
+static void lst_word(emit_output *out, segment_kind segment, int address, int word);
+static void lst_entry(emit_output *out, char *name, int address);
+static void lst_external(emit_output *out, char *name, int address);
+static void lst_end(emit_output *out);
+
+/* all the output formats */
+static const emitter emitters[] = {
+    {"ob", OBJECT_FILE, NULL, ob_begin, ob_word, NULL, NULL, NULL},
+    {"ent", ENTRIES_FILE, has_entries, NULL, NULL, symbol_line, NULL, NULL},
+    {"ext", EXTERN_FILE, has_externs, NULL, NULL, NULL, symbol_line, NULL},
+    {"obj", BINARY_FILE, NULL, NULL, NULL, NULL, NULL, obj_end},
+    {"bin", ".bin", NULL, NULL, bin_word, NULL, NULL, NULL},
+    {"hex", ".hex", NULL, hex_begin, hex_word, NULL, NULL, hex_end},
+    {"lst", ".lst", NULL, lst_begin, lst_word, lst_entry, lst_external, lst_end},
+    {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL}
+};
+
+
+/* Writes the outputs of the image which are on */
+void emit_image(asm_image *image) {
+    emit_output outs[sizeof(emitters) / sizeof(emitters[0])];
+    const emitter *on[sizeof(emitters) / sizeof(emitters[0])];
+    char *names[sizeof(emitters) / sizeof(emitters[0])];
+    node_ptr node;
+    symbol_node *symbol;
+    int i, j, cnt = 0;
+
+    /* Open all the outputs first, a failure leaves none of them */
+    for (i = 0; emitters[i].name != NULL; i++) {
+        if (!emitter_on(&emitters[i]) || (emitters[i].wanted != NULL && !emitters[i].wanted(image)))
+            continue;
+        names[cnt] = output_name(image->file_name, (char *)emitters[i].type);
+        outs[cnt].fp = open_output(names[cnt]);
+        outs[cnt].image = image;
+        outs[cnt].state = NULL;
+        on[cnt] = &emitters[i];
+        if (outs[cnt].fp == NULL) {
+            diag_printf("Error: could not open file");
+            for (j = 0; j <= cnt; j++) {
+                if (j < cnt)
+                    discard_output(outs[j].fp, names[j]);
+                asm_free(names[j]);
+            }
+            fatal_error(); /* Stop if file opening fails */
+        }
+        cnt++;
+    }
+
+    /* One walk over the image for all the outputs */
+    for (j = 0; j < cnt; j++) {
+        if (on[j]->begin != NULL)
+            on[j]->begin(&outs[j]);
+    }
+    for (i = 0; i < image->ic + image->dc; i++) {
+        for (j = 0; j < cnt; j++) {
+            if (on[j]->word == NULL)
+                continue;
+            if (i < image->ic)
+                on[j]->word(&outs[j], code_segment, INITIAL + i, image->instruction[i]);
+            else
+                on[j]->word(&outs[j], data_segment, INITIAL + i, image->data_code[i - image->ic]);
+        }
+    }
+    for (node = *image->entry_list; node != NULL; node = get_next(node)) {
+        symbol = (symbol_node *)get_data(node);
+        for (j = 0; j < cnt; j++) {
+            if (on[j]->entry != NULL)
+                on[j]->entry(&outs[j], get_symbol_name(symbol), get_address(symbol));
+        }
+    }
+    for (node = *image->extern_list; node != NULL; node = get_next(node)) {
+        symbol = (symbol_node *)get_data(node);
+        for (j = 0; j < cnt; j++) {
+            if (on[j]->external != NULL)
+                on[j]->external(&outs[j], get_symbol_name(symbol), get_address(symbol));
+        }
+    }
+    for (j = 0; j < cnt; j++) {
+        if (on[j]->end != NULL)
+            on[j]->end(&outs[j]);
+        close_output(outs[j].fp, names[j]); /* Close the file, it replaces the old one */
+        asm_free(names[j]);
+    }
+}
+
+/* Fills types with the extensions of the output files which are on, at most max, returns their number */
+int emit_types(const char *types[], int max) {
+    int i, cnt = 0;
+
+    for (i = 0; emitters[i].name != NULL && cnt < max; i++) {
+        if (emitter_on(&emitters[i]))
+            types[cnt++] = emitters[i].type;
+    }
+    return cnt;
+}
+
+/* Checks the names of an --emit list, returns 0 and prints an error for an unknown name */
+int emitters_valid(char *list) {
+    char name[16];
+    const char *p = list;
+    int i, len, found;
+
+    while (*p != '\0') {
+        len = strcspn(p, ",");
+        for (i = 0, found = 0; emitters[i].name != NULL; i++) {
+            if ((int)strlen(emitters[i].name) == len && strncmp(emitters[i].name, p, len) == 0)
+                found = 1;
+        }
+        if (!found) {
+            sprintf(name, "%.*s", len < 15 ? len : 15, p);
+            diag_printf("Error: unknown output format '%s'\n", name);
+            return 0;
+        }
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+    return 1;
+}
+
+/* Checks if an output is in the list of the options */
+static int emitter_on(const emitter *em) {
+    if (options.binary && strcmp(em->name, "obj") == 0)
+        return 1;
+    return in_list(options.emit != NULL ? options.emit : DEFAULT_EMIT, em->name);
+}
+
+/* Checks if a name is in a list separated by commas */
+static int in_list(const char *list, const char *name) {
+    int len = strlen(name);
+
+    while (*list != '\0') {
+        if ((int)strcspn(list, ",") == len && strncmp(list, name, len) == 0)
+            return 1;
+        list += strcspn(list, ",");
+        if (*list == ',')
+            list++;
+    }
+    return 0;
+}
+
+/* Extract a specific range of bits from an unsigned integer */
+static unsigned int extract_bits(unsigned int number, int startBit, int numBits) {
+    /* Create a bitmask to extract the desired bits*/
+    unsigned int bitmask = ((1 << numBits) - 1) << startBit;
+
+    /* Extract the desired bits using bitwise AND*/
+    return (number & bitmask) >> startBit;
+}
+
+/* Writes the word as 2 digits in base 64 to the text, returns the text */
+char *convert_to_base_64(int word, char text[3]) {
+    text[0] = base64[extract_bits(word, 6, 6)];
+    text[1] = base64[extract_bits(word, 0, 6)];
+    text[2] = '\0';
+    return text;
+}
+
+/* The .ob file starts with ic and dc */
+static void ob_begin(emit_output *out) {
+    fprintf(out->fp, "\n%d %d", out->image->ic, out->image->dc);
+}
+
+/* A word of the .ob file, 2 digits in base 64 */
+static void ob_word(emit_output *out, segment_kind segment, int address, int word) {
+    char text[3];
+
+    fprintf(out->fp, "\n%s", convert_to_base_64(word, text));
+}
+
+/* The .ent file is written if there are entries */
+static int has_entries(asm_image *image) {
+    return *image->entry_list != NULL;
+}
+
+/* The .ext file is written if there are extern references */
+static int has_externs(asm_image *image) {
+    return *image->extern_list != NULL;
+}
+
+/* A line of the .ent or the .ext file */
+static void symbol_line(emit_output *out, char *name, int address) {
+    fprintf(out->fp, "\n%s\t%d", name, address);
+}
+
+/* The .obj file is written at once, from the image */
+static void obj_end(emit_output *out) {
+    asm_image *image = out->image;
+    int *words; /* The instruction words and then the data words */
+    obj_symbol *entries, *externs;
+    int cnt_entries, cnt_externs;
+
+    words = (int *)asm_malloc((image->ic + image->dc + 1) * sizeof(int));
+    valid_allocate(words);
+    memcpy(words, image->instruction, image->ic * sizeof(int));
+    memcpy(words + image->ic, image->data_code, image->dc * sizeof(int));
+    entries = symbol_table_of(image->entry_list, &cnt_entries);
+    externs = symbol_table_of(image->extern_list, &cnt_externs);
+
+    obj_write(out->fp, image->ic, image->dc, words, entries, cnt_entries, externs, cnt_externs);
+    asm_free(words);
+    asm_free(entries);
+    asm_free(externs);
+}
+
+/* Copies a symbol list to a table of the binary object file, the names stay in the list */
+static obj_symbol *symbol_table_of(node_ref list, int *cnt) {
+    obj_symbol *table;
+    node_ptr temp; /* Iterator */
+
+    *cnt = 0;
+    for (temp = *list; temp != NULL; temp = get_next(temp))
+        (*cnt)++;
+    table = (obj_symbol *)asm_malloc((*cnt + 1) * sizeof(obj_symbol));
+    valid_allocate(table);
+
+    *cnt = 0;
+    for (temp = *list; temp != NULL; temp = get_next(temp)) {
+        table[*cnt].name = get_symbol_name((symbol_node *)get_data(temp));
+        table[(*cnt)++].address = get_address((symbol_node *)get_data(temp));
+    }
+    return table;
+}
+
+/* A word of the memory image */
+static void bin_word(emit_output *out, segment_kind segment, int address, int word) {
+    fputc(word & 0xff, out->fp);
+    fputc((word >> 8) & 0xf, out->fp);
+}
+
+/* state of the .hex file: the record being filled */
+typedef struct {
+    unsigned char bytes[HEX_RECORD];
+    int cnt;
+    int address;           /* byte address of the record */
+} hex_record;
+
+/* The .hex records start at the first address */
+static void hex_begin(emit_output *out) {
+    hex_record *rec = (hex_record *)asm_calloc(1, sizeof(hex_record));
+    valid_allocate(rec);
+    rec->address = INITIAL * 2;
+    out->state = rec;
+}
+
+/* A word of the .hex file, the record is written when it is full */
+static void hex_word(emit_output *out, segment_kind segment, int address, int word) {
+    hex_record *rec = (hex_record *)out->state;
+
+    rec->bytes[rec->cnt++] = word & 0xff;
+    rec->bytes[rec->cnt++] = (word >> 8) & 0xf;
+    if (rec->cnt == HEX_RECORD)
+        hex_flush(out);
+}
+
+/* Writes a data record: count, address, type 00, the bytes and the checksum */
+static void hex_flush(emit_output *out) {
+    hex_record *rec = (hex_record *)out->state;
+    unsigned int sum;
+    int i;
+
+    if (rec->cnt == 0)
+        return;
+    sum = rec->cnt + ((rec->address >> 8) & 0xff) + (rec->address & 0xff);
+    fprintf(out->fp, ":%02X%04X00", rec->cnt, rec->address & 0xffff);
+    for (i = 0; i < rec->cnt; i++) {
+        fprintf(out->fp, "%02X", rec->bytes[i]);
+        sum += rec->bytes[i];
+    }
+    fprintf(out->fp, "%02X\n", (0x100 - (sum & 0xff)) & 0xff);
+    rec->address += rec->cnt;
+    rec->cnt = 0;
+}
+
+/* The last record and the end of file record */
+static void hex_end(emit_output *out) {
+    hex_flush(out);
+    fprintf(out->fp, ":00000001FF\n");
+    asm_free(out->state);
+    out->state = NULL;
+}
+
+/* The title of the listing, the state holds the extern name of every code address which refers to one */
+static void lst_begin(emit_output *out) {
+    char **externs = (char **)asm_calloc(MAX_CODE, sizeof(char *));
+    node_ptr node;
+    int address;
+
+    valid_allocate(externs);
+    for (node = *out->image->extern_list; node != NULL; node = get_next(node)) {
+        address = (int)get_address((symbol_node *)get_data(node)) - INITIAL;
+        if (address >= 0 && address < MAX_CODE)
+            externs[address] = get_symbol_name((symbol_node *)get_data(node));
+    }
+    out->state = externs;
+    fprintf(out->fp, "; %s: %d instruction words, %d data words\n", out->image->file_name, out->image->ic, out->image->dc);
+    fprintf(out->fp, "; address  bits          base64  segment\n");
+}
+
+/* A word of the listing, an instruction word with a symbol shows its A,R,E and the extern name */
+static void lst_word(emit_output *out, segment_kind segment, int address, int word) {
+    char bits[13], text[3], **externs = (char **)out->state;
+    int i;
+
+    for (i = 0; i < 12; i++)
+        bits[i] = (word >> (11 - i)) & 1 ? '1' : '0';
+    bits[12] = '\0';
+    fprintf(out->fp, "%04d     %s  %s      %s", address, bits,
+            convert_to_base_64(word, text), segment == code_segment ? "code" : "data");
+    if (segment == code_segment) {
+        if (address - INITIAL < MAX_CODE && externs[address - INITIAL] != NULL)
+            fprintf(out->fp, "  E %s", externs[address - INITIAL]);
+        if ((word & 3) == 2)
+            fprintf(out->fp, "  R");
+    }
+    fprintf(out->fp, "\n");
+}
+
+/* An entry of the listing */
+static void lst_entry(emit_output *out, char *name, int address) {
+    fprintf(out->fp, "; entry   %s %d\n", name, address);
+}
+
+/* An extern reference of the listing */
+static void lst_external(emit_output *out, char *name, int address) {
+    fprintf(out->fp, "; extern  %s %d\n", name, address);
+}
+
+/* The listing is done */
+static void lst_end(emit_output *out) {
+    asm_free(out->state);
+    out->state = NULL;
+}
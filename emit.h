@@ -0,0 +1,61 @@
+#ifndef _EMIT_H_
+#define _EMIT_H_
+
+#include <stdio.h>
+#include "symbol_table.h"
+
+/* The output files are written by emitters. The assembled image is walked once:
+ * every output which is on gets the words in address order, then the entries
+ * and then the extern references, and writes its own file.
+ *
+ * The outputs are chosen by --emit, a list of names separated by commas, by
+ * default the .ob, .ent and .ext files (and the .obj with --binary). */
+
+/* the assembled program */
+typedef struct {
+    char *file_name;       /* the file name without extension */
+    int ic, dc;
+    int *instruction;
+    int *data_code;
+    node_ref entry_list;   /* entries, in the order of the .entry lines */
+    node_ref extern_list;  /* extern references, in address order */
+} asm_image;
+
+/* the segment of a word */
+typedef enum {
+    code_segment,
+    data_segment
+} segment_kind;
+
+/* an output file being written */
+typedef struct {
+    FILE *fp;
+    asm_image *image;
+    void *state;           /* kept by the emitter between the calls */
+} emit_output;
+
+/* an output format, a NULL callback is skipped */
+typedef struct {
+    const char *name;      /* name for --emit */
+    const char *type;      /* extension of the output file */
+    int (*wanted)(asm_image *image);   /* returns 0 if the image has nothing for this output */
+    void (*begin)(emit_output *out);
+    void (*word)(emit_output *out, segment_kind segment, int address, int word);
+    void (*entry)(emit_output *out, char *name, int address);
+    void (*external)(emit_output *out, char *name, int address);
+    void (*end)(emit_output *out);
+} emitter;
+
+/* Writes the outputs of the image which are on */
+void emit_image(asm_image *image);
+
+/* Fills types with the extensions of the output files which are on, at most max, returns their number */
+int emit_types(const char *types[], int max);
+
+/* Checks the names of an --emit list, returns 0 and prints an error for an unknown name */
+int emitters_valid(char *list);
+
+/* Writes the word as 2 digits in base 64 to the text, returns the text */
+char *convert_to_base_64(int word, char text[3]);
+
+#endif
@@ -1,48 +1,66 @@
 #include "compile.h"
+#include "line_index.h"
+#include "options.h"
+#include "stats.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-/*** Function prototypes ***/
+/* a block of the data segment, from a data label to the next one */
+typedef struct {
+	symbol_node *symbol;
+	int start;	/* dc of the first word */
+	int len;
+	unsigned long hash;
+} data_block;
 
-/* Build the symbol table based on the provided line_ast, update data_code if needed */
-void build_symbol_table(syntax_ast line_ast, node_ref symbol_head, int data_code[]);
+/*** Function prototypes ***/
 
 /* Update the address of symbols in the symbol table */
 void update_symbol_address(node_ref symbol_head);
 
+/* Keep one copy of the data blocks with the same words, the labels of the copies point to it */
+static void pool_data(node_ref symbol_head, int data_code[]);
+
+/* Order the data blocks by their place in the data segment */
+static int compare_blocks(const void *a, const void *b);
+
 /* Check if the provided syntax_ast has an error */
 int is_error(syntax_ast);
 
 /* Check if the provided syntax_ast defines a label */
 int def_label(syntax_ast);
 
-/* Encode an array of integers as data into the data_code array */
+/* Encode the data words of a .data line into the data_code array, as many as fit in the memory */
 void encode_data(int data[], int cnt_data, int data_code[]);
 
-/* Encode a string as data into the data_code array */
-void encode_string(char string[], int data_code[]);
+/* Encode the values of a .data line which are read from the text of the line straight into the data_code array */
+void encode_data_span(char text[], int data_code[]);
+
+/* Encode len chars of a string as data into the data_code array, the chars are widened to data words */
+void encode_string(char string[], int len, int data_code[]);
 
 
 
-extern int cnt_line;	/* line number to show in errors */
-extern bool has_error;	/* to prevent output file creation if an error was found */
-extern int ic;
-extern int dc;
-extern char *file_am_name;
+extern per_thread int cnt_line;	/* line number to show in errors */
+extern per_thread bool has_error;	/* to prevent output file creation if an error was found */
+extern per_thread int ic;
+extern per_thread int dc;
+extern per_thread char *file_am_name;
 
 
 /* coding data code and build symbol table*/
 void first_iteration(FILE *am_file, node_ref symbol_head, int data_code []){
     syntax_ast line_ast = {0};
-	char line_buffer[MAX_LINE_LENGTH] = {0};
+	char *line_buffer = NULL;
+	int size;
 	char ch;
     /* Process each line */
-    while (fgets(line_buffer,sizeof(line_buffer),am_file))
+    while (read_line(am_file, &line_buffer, &size))
 	{
 		cnt_line++; /* line counter */
-		if (strlen(line_buffer) == MAX_LINE_LENGTH - 1 && line_buffer[MAX_LINE_LENGTH - 2] != '\n') {
-			printf("\n Error in %s, line %d: line in input file is longer than 80 chars ", file_am_name, cnt_line);
-			has_error = TRUE;
+		if (line_too_long(line_buffer)) {
+			long_line_error();
 
             /* Read and discard remaining characters of the long line*/
             while ((ch = fgetc(am_file)) != EOF && ch != '\n')
@@ -57,65 +75,116 @@ void first_iteration(FILE *am_file, node_ref symbol_head, int data_code []){
 		line_ast = syntax_ast_parse(line_buffer);
 		build_symbol_table(line_ast, symbol_head,data_code);	
     }
+	asm_free(line_buffer);
+	finish_first_iteration(symbol_head, data_code);
+}
+
+/* Check the memory limits and move the data symbols after the code, with --dedup-data the
+ * identical data blocks are pooled first so the memory check sees the smaller segment */
+void finish_first_iteration(node_ref symbol_head, int data_code[]){
+	if(options.dedup_data && !has_error && dc <= MAX_CODE)
+		pool_data(symbol_head, data_code);
 	if(ic + dc + INITIAL> MAX_CODE){
-		printf("Error: memory required exceeds the limits of the RAM in the machine");
+		diag_printf("Error: memory required exceeds the limits of the RAM in the machine");
 		has_error = TRUE;
 	}
 	update_symbol_address(symbol_head);
 }
+
+/* Report a line which is longer than the allowed length */
+void long_line_error(){
+	diag_printf("\n Error in %s, line %d: line in input file is longer than 80 chars ", file_am_name, cnt_line);
+	has_error = TRUE;
+}
 	
 /* Build the symbol table based on the provided line_ast, update data_code if needed */
 void build_symbol_table(syntax_ast line_ast, node_ref symbol_head, int data_code[]) {
+    int code_words, data_words;
+
+    if (!add_line_symbols(&line_ast, symbol_head))
+        return;
+    line_words(&line_ast, &code_words, &data_words);
+    ic += code_words;
+    encode_line_data(&line_ast, data_code);
+}
+
+/* Add the symbols the line defines at the current ic/dc, returns 0 if the line has an error */
+int add_line_symbols(syntax_ast *line_ast, node_ref symbol_head) {
     /* Check if the line has an error */
-    if (is_error(line_ast)) {
-        printf("\nError in %s, line %d: %s \n",file_am_name, cnt_line, line_ast.syntax_error);
+    if (is_error(*line_ast)) {
+        diag_printf("\nError in %s, line %d: %s \n",file_am_name, cnt_line, line_ast->syntax_error);
         has_error = TRUE;
-        return;
+        return 0;
 
-    }else if (def_label(line_ast)) {
+    }else if (def_label(*line_ast)) {
         /* Check if the line defines a label */
-        if (line_ast.opt_ast == instruct)
-            add_symbol(symbol_head, ic + INITIAL, line_ast.label_name, code_relocatable);
+        if (line_ast->opt_ast == instruct)
+            add_symbol(symbol_head, ic + INITIAL, line_ast->label_name, code_relocatable);
 
-        else if (line_ast.opt_ast == direct) {
-            if (line_ast.dir_inst.direct.dir_opt == opt_string || line_ast.dir_inst.direct.dir_opt == opt_data)
-                add_symbol(symbol_head, dc + INITIAL, line_ast.label_name, data_relocatable);
+        else if (line_ast->opt_ast == direct) {
+            if (line_ast->dir_inst.direct.dir_opt == opt_string || line_ast->dir_inst.direct.dir_opt == opt_data)
+                add_symbol(symbol_head, dc + INITIAL, line_ast->label_name, data_relocatable);
 
             else
-                printf("\n *Warning* in %s, line %d: declaration of symbol before entry or extern instructions  \n",file_am_name ,cnt_line);
+                diag_printf("\n *Warning* in %s, line %d: declaration of symbol before entry or extern instructions  \n",file_am_name ,cnt_line);
         }
     }
-    switch (line_ast.opt_ast) {
+    if (line_ast->opt_ast == direct && line_ast->dir_inst.direct.dir_opt == opt_extern)
+        add_symbol(symbol_head, 0, line_ast->dir_inst.direct.direct_params.symbol, external);
+    return 1;
+}
+
+/* Count the instruction words and the data words of the line */
+void line_words(syntax_ast *line_ast, int *code_words, int *data_words) {
+    *code_words = 0;
+    *data_words = 0;
+    if (is_error(*line_ast))
+        return;
+    switch (line_ast->opt_ast) {
         case instruct:
             /* Process instruction */
-            ic++;
-            if ((line_ast.dir_inst.instruct.inst_opt >= instruct_mov && line_ast.dir_inst.instruct.inst_opt <= instruct_sub) ||
-                line_ast.dir_inst.instruct.inst_opt == instruct_lea) {
-                if (line_ast.dir_inst.instruct.op_met[1] == reg_num_op && line_ast.dir_inst.instruct.op_met[0] == reg_num_op)
-                    ic++;/*only one word for two registers as opeands*/
+            *code_words = 1;
+            if ((line_ast->dir_inst.instruct.inst_opt >= instruct_mov && line_ast->dir_inst.instruct.inst_opt <= instruct_sub) ||
+                line_ast->dir_inst.instruct.inst_opt == instruct_lea) {
+                if (line_ast->dir_inst.instruct.op_met[1] == reg_num_op && line_ast->dir_inst.instruct.op_met[0] == reg_num_op)
+                    *code_words += 1;/*only one word for two registers as opeands*/
                 else
-                    ic += 2;/*two opearnds to be added*/
-            } else if (line_ast.dir_inst.instruct.inst_opt == instruct_not ||
-                       line_ast.dir_inst.instruct.inst_opt == instruct_clr ||
-                       (line_ast.dir_inst.instruct.inst_opt >= instruct_inc &&
-                        line_ast.dir_inst.instruct.inst_opt <= instruct_jsr)) {
-                ic++;
+                    *code_words += 2;/*two opearnds to be added*/
+            } else if (line_ast->dir_inst.instruct.inst_opt == instruct_not ||
+                       line_ast->dir_inst.instruct.inst_opt == instruct_clr ||
+                       (line_ast->dir_inst.instruct.inst_opt >= instruct_inc &&
+                        line_ast->dir_inst.instruct.inst_opt <= instruct_jsr)) {
+                *code_words += 1;
             }
             break;
         case direct:
             /* Process directive */
-            if (line_ast.dir_inst.direct.dir_opt == opt_data) {
-                encode_data(line_ast.dir_inst.direct.direct_params.data_s.data_arr,
-                            line_ast.dir_inst.direct.direct_params.data_s.cnt_data, data_code);
-            } else if (line_ast.dir_inst.direct.dir_opt == opt_string) {
-                encode_string(line_ast.dir_inst.direct.direct_params.string, data_code);
-            } else if (line_ast.dir_inst.direct.dir_opt == opt_extern) {
-                add_symbol(symbol_head, 0, line_ast.dir_inst.direct.direct_params.symbol, external);
-            }
+            if (line_ast->dir_inst.direct.dir_opt == opt_data)
+                *data_words = line_ast->dir_inst.direct.direct_params.data_s.cnt_data;
+            else if (line_ast->dir_inst.direct.dir_opt == opt_string)
+                *data_words = line_ast->dir_inst.direct.span.len + 1;
             break;
     }
 }
 
+/* Encode the data of a .data or .string line at the current dc */
+void encode_line_data(syntax_ast *line_ast, int data_code[]) {
+    text_span *span;
+
+    if (is_error(*line_ast) || line_ast->opt_ast != direct)
+        return;
+    /* Operands which didn't fit in the ast are streamed from the line to the data */
+    span = operand_span(line_ast);
+    if (line_ast->dir_inst.direct.dir_opt == opt_data && span != NULL) {
+        encode_data_span(span->line + span->start, data_code);
+    } else if (line_ast->dir_inst.direct.dir_opt == opt_data) {
+        encode_data(line_ast->dir_inst.direct.direct_params.data_s.data_arr,
+                    line_ast->dir_inst.direct.direct_params.data_s.cnt_data, data_code);
+    } else if (line_ast->dir_inst.direct.dir_opt == opt_string) {
+        encode_string(span->line + span->start, span->len, data_code);
+    }
+}
+
 /* Update the address of symbols in the symbol table */
 void update_symbol_address(node_ref symbol_head){
 	symbol_node *current;
@@ -135,6 +204,62 @@ void update_symbol_address(node_ref symbol_head){
 	} while ((temp = get_next(temp)) != NULL);
 }
 
+/* Keep one copy of the data blocks with the same words, the labels of the copies point to it.
+ * A block runs from a data label to the next data label or to the end of the segment, the words
+ * before the first label have no name and stay in place. The blocks which are kept are moved down
+ * over the removed ones, and dc becomes the size of the smaller segment. */
+static void pool_data(node_ref symbol_head, int data_code[]){
+	data_block *blocks;
+	node_ptr temp;
+	int cnt = 0, i, j, k, write, start;
+
+	for (temp = *symbol_head; temp != NULL; temp = get_next(temp))
+		if (get_type((symbol_node*)get_data(temp)) == data_relocatable)
+			cnt++;
+	if (cnt < 2)
+		return;
+	blocks = (data_block*)asm_malloc(cnt * sizeof(data_block));
+	valid_allocate(blocks);
+	for (temp = *symbol_head, i = 0; temp != NULL; temp = get_next(temp))
+		if (get_type((symbol_node*)get_data(temp)) == data_relocatable) {
+			blocks[i].symbol = (symbol_node*)get_data(temp);
+			blocks[i].start = get_address(blocks[i].symbol) - INITIAL;
+			i++;
+		}
+	qsort(blocks, cnt, sizeof(data_block), compare_blocks);
+
+	write = blocks[0].start;
+	for (i = 0; i < cnt; i++) {
+		start = blocks[i].start;
+		blocks[i].len = (i + 1 < cnt ? blocks[i + 1].start : dc) - start;
+		blocks[i].hash = 2166136261UL;
+		for (k = 0; k < blocks[i].len; k++)
+			blocks[i].hash = ((blocks[i].hash ^ (unsigned int)data_code[start + k]) * 16777619UL) & 0xffffffffUL;
+
+		/* the blocks before this one already moved to their new start */
+		for (j = 0; j < i; j++)
+			if (blocks[j].hash == blocks[i].hash && blocks[j].len == blocks[i].len && blocks[j].symbol != NULL &&
+			    memcmp(&data_code[blocks[j].start], &data_code[start], blocks[i].len * sizeof(int)) == 0)
+				break;
+		if (j < i) {
+			set_address(blocks[i].symbol, blocks[j].start - start);
+			stats_count(stat_data_words_pooled, blocks[i].len);
+			blocks[i].symbol = NULL;	/* not a copy to compare with */
+			continue;
+		}
+		memmove(&data_code[write], &data_code[start], blocks[i].len * sizeof(int));
+		set_address(blocks[i].symbol, write - start);
+		blocks[i].start = write;
+		write += blocks[i].len;
+	}
+	dc = write;
+	asm_free(blocks);
+}
+
+/* Order the data blocks by their place in the data segment */
+static int compare_blocks(const void *a, const void *b){
+	return ((data_block*)a)->start - ((data_block*)b)->start;
+}
 
 /* Check if there is a syntax error in the line_ast */
 int is_error(syntax_ast line_ast) {
@@ -154,40 +279,40 @@ int def_label(syntax_ast line_ast) {
     }
 }
 
-/* Encode an array of integers as data into the data_code array */
+/* Encode the data words of a .data line into the data_code array, as many as fit in the memory */
 void encode_data(int data[], int cnt_data, int data_code[]) {
-    int i;
-    unsigned short int coding = 0;
-    
-    for (i = 0; i < cnt_data; i++) {
-        /* Convert each data element to its value */
-        coding = data[i];
-        
-        /* Check if there's space in the data_code array to store the value */
-        if (dc < MAX_CODE) {
-            data_code[dc++] = coding;
-        }
+    int cnt = cnt_data < MAX_CODE - dc ? cnt_data : MAX_CODE - dc;
+
+    /* The parser already made the values data words, they are copied at once */
+    if (cnt > 0) {
+        memcpy(&data_code[dc], data, cnt * sizeof(int));
+        dc += cnt;
     }
 }
 
-/* Encode a string as data into the data_code array */
-void encode_string(char string[], int data_code[]) {
-    int i;
-    int len = strlen(string);
-    unsigned short int coding = 0;
-    
-    for (i = 0; i < len; i++) {
-        /* Convert each character to its ASCII value */
-        coding = string[i];
-        
-        /* Check if there's space in the data_code array to store the value */
-        if (dc < MAX_CODE) {
-            data_code[dc++] = coding;
-        }
-    }
-    
+/* Encode the values of a .data line which are read from the text of the line straight into the data_code array */
+void encode_data_span(char text[], int data_code[]) {
+    int cnt, room = dc < MAX_CODE ? MAX_CODE - dc : 0;
+
+    parse_data_list(text, &data_code[dc], room, &cnt);
+    dc += cnt < room ? cnt : room;
+}
+
+/* Encode len chars of a string as data into the data_code array, the chars are widened to data words */
+void encode_string(char string[], int len, int data_code[]) {
+    int i, cnt = len < MAX_CODE - dc ? len : MAX_CODE - dc;
+
+    /* The chars which fit in the memory, printable chars are their ASCII values */
+    for (i = 0; i < cnt; i++)
+        data_code[dc + i] = (unsigned char)string[i];
+    if (cnt > 0)
+        dc += cnt;
+
     /* Add a null terminator character to signify the end of the string */
-    data_code[dc++] = 0;
+    if (dc < MAX_CODE) {
+        data_code[dc] = 0;
+    }
+    dc++;
 }
 
 
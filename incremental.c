@@ -0,0 +1,560 @@
+/*** incremental.c compiles a file again, reusing the lines which didn't change ***/
+#include "compile.h"
+#include "line_index.h"
+#include "cache.h"
+#include "stats.h"
+#include "incremental.h"
+
+extern per_thread int cnt_line;	/* line number to show in errors */
+extern per_thread bool has_error;	/* to prevent output file creation if an error was found */
+extern per_thread int ic;
+extern per_thread int dc;
+extern per_thread char *file_am_name;
+
+#define STATE_FORMAT "asm-inc 2"
+
+/* a line of the am_file, as kept in the state file */
+typedef struct {
+    unsigned long hash[2];   /* hash of the text of the line */
+    int length;
+    bool too_long;
+    bool parsed;             /* FALSE for comments, empty lines and long lines */
+    bool encoded;            /* the instruction words of the line are in the state */
+    bool has_span;           /* the ast reads its operands from the line, the span keeps only the offsets */
+    int code_words, data_words;
+    int ic, dc;              /* addresses of the line */
+} line_state;
+
+/* a symbol, as kept in the state file */
+typedef struct {
+    char name[MAX_SYMBOL_LENGTH];
+    int address;
+    symbol_type type;
+} symbol_state;
+
+/* start of the state file, followed by the lines, the parsed lines, the symbols and the instruction words */
+typedef struct {
+    char format[16];
+    char build[32];
+    int cnt_lines, cnt_asts, cnt_symbols;
+    int total_ic, total_dc;
+    unsigned long check[2];  /* hash of the rest of the file, a file which was changed is not used */
+} state_header;
+
+/* the state of a compile */
+struct inc_state {
+    state_header header;
+    line_state *lines;
+    syntax_ast *asts;        /* the parsed lines, in line order */
+    symbol_state *symbols;
+    int *symbol_index;       /* hash table of the symbols by name, -1 for a free bucket */
+    int size_index;          /* buckets of symbol_index, a power of 2 */
+    int instruction[MAX_CODE];
+};
+
+/* a line of the current compile */
+typedef struct {
+    line_state state;
+    syntax_ast *ast;         /* in the old state, or in the parsed lines of this compile */
+    int old_ic;              /* address of the words in the old state */
+} inc_line;
+
+/*** functions prototypes ***/
+
+/* Reads the state of the last compile, returns 0 if there is none for this build */
+static int load_state(char *path, inc_state *st);
+
+/* Writes the state to the file */
+static void save_state(char *path, inc_state *st);
+
+/* Replaces the state with the state of this compile */
+static void keep_state(inc_state *st, inc_line lines[], int cnt_lines, node_ref symbol_head, int instruction[]);
+
+/* Frees the state */
+static void clear_state(inc_state *st);
+
+/* Hashes the lines, the parsed lines, the symbols and the instruction words of the state */
+static void state_check(inc_state *st, unsigned long check[2]);
+
+/* Checks if a parsed line of a state file can be used, its fields are in range and its strings end */
+static bool ast_valid(syntax_ast *sa, line_state *line);
+
+/* Compares a line of the am_file to a line of the state */
+static bool same_line(line_entry *entry, line_state *old);
+
+/* Builds the hash table of the symbols of the state */
+static void index_symbols(inc_state *st);
+
+/* Hash bucket of a symbol name */
+static int bucket_of(char *name, int size_index);
+
+/* Finds a symbol of the state by name, returns NULL if not found */
+static symbol_state *old_symbol(inc_state *st, char *name);
+
+/* Checks if the words of a reused instruction are still right, the symbols it uses didn't change */
+static bool words_valid(inc_line *line, node_ref symbol_head, inc_state *old);
+
+/* Checks if an entry names an extern symbol, which changes the encoding of the lines after it */
+static bool entry_of_extern(inc_line lines[], int cnt_lines, node_ref symbol_head);
+
+
+/* compiles the am_file, reusing the state of the last compile */
+void compile_incremental(char *file_name) {
+    char *state_name = output_name(file_name, STATE_FILE);
+    inc_state *st = state_create();
+
+    load_state(state_name, st);
+    compile_with_state(file_name, st);
+    save_state(state_name, st);
+    state_destroy(st);
+    asm_free(state_name);
+}
+
+/* Creates an empty state, the first compile with it compiles every line */
+inc_state *state_create() {
+    inc_state *st = (inc_state *)asm_calloc(1, sizeof(inc_state));
+    valid_allocate(st);
+    return st;
+}
+
+/* Frees the state */
+void state_destroy(inc_state *st) {
+    clear_state(st);
+    asm_free(st);
+}
+
+/* compiles the am_file, reusing the state, which is replaced by the state of this compile */
+void compile_with_state(char *file_name, inc_state *old) {
+    char *amfile_name;
+    line_index index;
+    inc_line *lines;
+    syntax_ast *parsed;
+    int instruction[MAX_CODE], data_code[MAX_CODE];
+    node_ptr symbol_head = NULL, extern_list = NULL, entry_list = NULL;
+    int cnt, prefix = 0, suffix = 0, i, j, total_ic, total_dc, delta_ic, delta_dc;
+    bool saved_error, serial;
+    stats_state prev = stats_enter(file_name, phase_first_iteration);
+
+    amfile_name = output_name(file_name, MACRO_FILE);
+    if (!load_line_index(amfile_name, &index)) {
+        diag_printf("Error: couldn't open file");
+        asm_free(amfile_name);
+        fatal_error();
+    }
+    cnt = index.cnt_lines;
+    lines = (inc_line *)asm_calloc(cnt + 1, sizeof(inc_line));
+    valid_allocate(lines);
+
+    /* The lines which didn't change at the start and at the end of the file */
+    while (prefix < cnt && prefix < old->header.cnt_lines && same_line(&index.lines[prefix], &old->lines[prefix]))
+        prefix++;
+    while (suffix < cnt - prefix && suffix < old->header.cnt_lines - prefix &&
+           same_line(&index.lines[cnt - 1 - suffix], &old->lines[old->header.cnt_lines - 1 - suffix]))
+        suffix++;
+
+    /* Reuse the parsed lines of the state */
+    for (i = 0, j = 0; i < old->header.cnt_lines; i++) {
+        if (i < prefix || i >= old->header.cnt_lines - suffix) {
+            lines[i < prefix ? i : i - old->header.cnt_lines + cnt].state = old->lines[i];
+            lines[i < prefix ? i : i - old->header.cnt_lines + cnt].ast = old->lines[i].parsed ? &old->asts[j] : NULL;
+            lines[i < prefix ? i : i - old->header.cnt_lines + cnt].old_ic = old->lines[i].ic;
+        }
+        if (old->lines[i].parsed)
+            j++;
+    }
+    /* A span of the state has only the offsets, the same line of this compile has the same text */
+    for (i = 0; i < cnt; i++) {
+        if (lines[i].ast != NULL && lines[i].state.has_span)
+            lines[i].ast->dir_inst.direct.span.line = index.lines[i].text;
+    }
+
+    /* Parse the edited lines, they start where the unchanged start ends */
+    parsed = (syntax_ast *)asm_malloc((cnt - prefix - suffix + 1) * sizeof(syntax_ast));
+    valid_allocate(parsed);
+    total_ic = prefix > 0 ? lines[prefix - 1].state.ic + lines[prefix - 1].state.code_words : 0;
+    total_dc = prefix > 0 ? lines[prefix - 1].state.dc + lines[prefix - 1].state.data_words : 0;
+    for (i = prefix; i < cnt - suffix; i++) {
+        line_state *st = &lines[i].state;
+
+        st->hash[0] = 2166136261UL;
+        st->hash[1] = 5381UL;
+        st->length = strlen(index.lines[i].text);
+        hash_text(index.lines[i].text, st->length, st->hash);
+        st->too_long = index.lines[i].too_long;
+        st->ic = total_ic;
+        st->dc = total_dc;
+        /* skip long lines, comment and empty line*/
+        if (st->too_long || comment_empty_line(index.lines[i].text))
+            continue;
+        st->parsed = TRUE;
+        lines[i].ast = &parsed[i - prefix];
+        *lines[i].ast = syntax_ast_parse(index.lines[i].text);
+        st->has_span = operand_span(lines[i].ast) != NULL;
+        line_words(lines[i].ast, &st->code_words, &st->data_words);
+        total_ic += st->code_words;
+        total_dc += st->data_words;
+    }
+
+    /* The unchanged end moves by the change in the words of the edited lines */
+    if (suffix > 0) {
+        delta_ic = total_ic - lines[cnt - suffix].state.ic;
+        delta_dc = total_dc - lines[cnt - suffix].state.dc;
+        for (i = cnt - suffix; i < cnt; i++) {
+            lines[i].state.ic += delta_ic;
+            lines[i].state.dc += delta_dc;
+        }
+        total_ic = lines[cnt - 1].state.ic + lines[cnt - 1].state.code_words;
+        total_dc = lines[cnt - 1].state.dc + lines[cnt - 1].state.data_words;
+    }
+
+    /* First iteration: the symbols are added in line order, for the same diagnostics as a full compile */
+    initialize_vars(instruction, data_code);
+    file_am_name = amfile_name;
+    for (i = 0; i < cnt; i++) {
+        cnt_line = index.lines[i].line_number;
+        if (lines[i].state.too_long) {
+            long_line_error();
+        } else if (lines[i].state.parsed) {
+            ic = lines[i].state.ic;
+            dc = lines[i].state.dc;
+            add_line_symbols(lines[i].ast, &symbol_head);
+            encode_line_data(lines[i].ast, data_code);
+        }
+    }
+    ic = total_ic;
+    dc = total_dc;
+    finish_first_iteration(&symbol_head, data_code);
+    total_dc = dc;
+
+    /* Second iteration, the instructions whose symbols didn't change keep their words */
+    stats_enter(file_name, phase_second_iteration);
+    if (has_error) {
+        /* No words are written, the next compile encodes every line */
+        for (i = 0; i < cnt; i++)
+            lines[i].state.encoded = FALSE;
+    } else {
+        serial = entry_of_extern(lines, cnt, &symbol_head);
+        ic = 0;
+        for (i = 0; i < cnt; i++) {
+            if (!lines[i].state.parsed)
+                continue;
+            cnt_line = index.lines[i].line_number;
+            if (!serial && lines[i].ast->opt_ast == instruct) {
+                if (words_valid(&lines[i], &symbol_head, old)) {
+                    memcpy(&instruction[lines[i].state.ic], &old->instruction[lines[i].old_ic], lines[i].state.code_words * sizeof(int));
+                    stats_count(stat_lines_reused, 1);
+                    continue;
+                }
+                ic = lines[i].state.ic;
+                stats_count(stat_lines_encoded, 1);
+            }
+            saved_error = has_error;
+            has_error = FALSE;
+            second_iteration_line(lines[i].ast, &symbol_head, &extern_list, &entry_list, instruction);
+            lines[i].state.encoded = !serial && !has_error;
+            has_error = has_error || saved_error;
+        }
+        ic = total_ic;
+        dc = total_dc;
+        create_output_files(file_name, instruction, data_code, &entry_list, &extern_list);
+    }
+
+    keep_state(old, lines, cnt, &symbol_head, instruction);
+
+    clear_list(&extern_list);
+    clear_list(&entry_list);
+    clear_list(&symbol_head);
+    clear_line_index(&index);
+    asm_free(parsed);
+    asm_free(lines);
+    asm_free(amfile_name);
+    file_am_name = NULL;
+    stats_leave(prev);
+}
+
+/* Compares a line of the am_file to a line of the state */
+static bool same_line(line_entry *entry, line_state *old) {
+    unsigned long h[2] = {2166136261UL, 5381UL};
+    int length = strlen(entry->text);
+
+    if (length != old->length || entry->too_long != old->too_long)
+        return FALSE;
+    hash_text(entry->text, length, h);
+    return h[0] == old->hash[0] && h[1] == old->hash[1];
+}
+
+/* Checks if the words of a reused instruction are still right, the symbols it uses didn't change */
+static bool words_valid(inc_line *line, node_ref symbol_head, inc_state *old) {
+    symbol_node *found;
+    symbol_state *old_found;
+    int i;
+
+    if (!line->state.encoded)
+        return FALSE;
+    for (i = 0; i < 2; i++) {
+        if (line->ast->dir_inst.instruct.op_met[i] != label_op)
+            continue;
+        found = get_symbol(symbol_head, line->ast->dir_inst.instruct.op_opt[i].symbol);
+        old_found = old_symbol(old, line->ast->dir_inst.instruct.op_opt[i].symbol);
+        /* An extern adds a reference at the address of the word */
+        if (found == NULL || old_found == NULL || get_type(found) == external || old_found->type == external ||
+            (int)get_address(found) != old_found->address)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Builds the hash table of the symbols of the state, with at least 2 buckets per symbol */
+static void index_symbols(inc_state *st) {
+    int i, h;
+
+    for (st->size_index = 16; st->size_index < 2 * st->header.cnt_symbols; st->size_index *= 2)
+        ;
+    st->symbol_index = (int *)asm_malloc(st->size_index * sizeof(int));
+    valid_allocate(st->symbol_index);
+    memset(st->symbol_index, -1, st->size_index * sizeof(int));
+    for (i = 0; i < st->header.cnt_symbols; i++) {
+        h = bucket_of(st->symbols[i].name, st->size_index);
+        while (st->symbol_index[h] >= 0)
+            h = (h + 1) & (st->size_index - 1);
+        st->symbol_index[h] = i;
+    }
+}
+
+/* Hash bucket of a symbol name */
+static int bucket_of(char *name, int size_index) {
+    unsigned long h[2] = {2166136261UL, 5381UL};
+
+    hash_text(name, strlen(name), h);
+    return (int)(h[0] & (size_index - 1));
+}
+
+/* Finds a symbol of the state by name, returns NULL if not found */
+static symbol_state *old_symbol(inc_state *st, char *name) {
+    int h;
+
+    if (st->symbol_index == NULL)
+        return NULL;
+    for (h = bucket_of(name, st->size_index); st->symbol_index[h] >= 0; h = (h + 1) & (st->size_index - 1)) {
+        if (strcmp(st->symbols[st->symbol_index[h]].name, name) == 0)
+            return &st->symbols[st->symbol_index[h]];
+    }
+    return NULL;
+}
+
+/* Checks if an entry names an extern symbol, which changes the encoding of the lines after it */
+static bool entry_of_extern(inc_line lines[], int cnt_lines, node_ref symbol_head) {
+    symbol_node *found;
+    int i;
+
+    for (i = 0; i < cnt_lines; i++) {
+        if (lines[i].state.parsed && lines[i].ast->opt_ast == direct && lines[i].ast->dir_inst.direct.dir_opt == opt_entry) {
+            found = get_symbol(symbol_head, lines[i].ast->dir_inst.direct.direct_params.symbol);
+            if (found != NULL && get_type(found) == external)
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Reads the state of the last compile, returns 0 if there is none for this build */
+static int load_state(char *path, inc_state *st) {
+    FILE *fp = fopen(path, "rb");
+    state_header *h = &st->header;
+    unsigned long check[2];
+    int i, j, ok;
+
+    clear_state(st);
+    if (fp == NULL)
+        return 0;
+    ok = fread(h, sizeof(state_header), 1, fp) == 1 &&
+         strncmp(h->format, STATE_FORMAT, sizeof(h->format)) == 0 &&
+         strncmp(h->build, build_id(), sizeof(h->build)) == 0 &&
+         h->cnt_lines >= 0 && h->cnt_asts >= 0 && h->cnt_asts <= h->cnt_lines && h->cnt_symbols >= 0 &&
+         h->total_ic >= 0 && h->total_ic <= MAX_CODE;
+    if (ok) {
+        st->lines = (line_state *)asm_malloc((h->cnt_lines + 1) * sizeof(line_state));
+        st->asts = (syntax_ast *)asm_malloc((h->cnt_asts + 1) * sizeof(syntax_ast));
+        st->symbols = (symbol_state *)asm_malloc((h->cnt_symbols + 1) * sizeof(symbol_state));
+        valid_allocate(st->lines);
+        valid_allocate(st->asts);
+        valid_allocate(st->symbols);
+        ok = fread(st->lines, sizeof(line_state), h->cnt_lines, fp) == (size_t)h->cnt_lines &&
+             fread(st->asts, sizeof(syntax_ast), h->cnt_asts, fp) == (size_t)h->cnt_asts &&
+             fread(st->symbols, sizeof(symbol_state), h->cnt_symbols, fp) == (size_t)h->cnt_symbols &&
+             fread(st->instruction, sizeof(int), h->total_ic, fp) == (size_t)h->total_ic;
+    }
+    if (ok) {
+        state_check(st, check);
+        ok = check[0] == h->check[0] && check[1] == h->check[1];
+    }
+    /* The addresses of the lines must be inside the words, and every parsed line must be one this build could parse */
+    for (i = 0, j = 0; ok && i < h->cnt_lines; i++) {
+        line_state *line = &st->lines[i];
+
+        if (line->ic < 0 || line->code_words < 0 || line->ic + line->code_words > MAX_CODE ||
+            line->dc < 0 || line->data_words < 0 || line->dc + line->data_words > MAX_CODE || line->length < 0)
+            ok = 0;
+        else if (line->parsed)
+            ok = j < h->cnt_asts && !line->too_long && ast_valid(&st->asts[j++], line);
+        else
+            ok = !line->encoded && !line->has_span && line->code_words == 0 && line->data_words == 0;
+    }
+    ok = ok && j == h->cnt_asts;
+    fclose(fp);
+    if (!ok) {
+        clear_state(st);
+        return 0;
+    }
+    for (i = 0; i < h->cnt_symbols; i++)
+        st->symbols[i].name[MAX_SYMBOL_LENGTH - 1] = '\0';
+    index_symbols(st);
+    return 1;
+}
+
+/* Replaces the state with the state of this compile */
+static void keep_state(inc_state *st, inc_line lines[], int cnt_lines, node_ref symbol_head, int instruction[]) {
+    inc_state now;
+    state_header *h = &now.header;
+    node_ptr node;
+    int i;
+
+    /* The lines point into the old state, it is freed once they are copied */
+    memset(h, 0, sizeof(state_header));
+    strncpy(h->format, STATE_FORMAT, sizeof(h->format) - 1);
+    strncpy(h->build, build_id(), sizeof(h->build) - 1);
+    h->cnt_lines = cnt_lines;
+    for (i = 0; i < cnt_lines; i++) {
+        if (lines[i].state.parsed)
+            h->cnt_asts++;
+    }
+    for (node = *symbol_head; node != NULL; node = get_next(node))
+        h->cnt_symbols++;
+    h->total_ic = ic <= MAX_CODE ? ic : 0;
+    h->total_dc = dc;
+
+    now.lines = (line_state *)asm_malloc((h->cnt_lines + 1) * sizeof(line_state));
+    now.asts = (syntax_ast *)asm_malloc((h->cnt_asts + 1) * sizeof(syntax_ast));
+    now.symbols = (symbol_state *)asm_calloc(h->cnt_symbols + 1, sizeof(symbol_state));
+    valid_allocate(now.lines);
+    valid_allocate(now.asts);
+    valid_allocate(now.symbols);
+    for (i = 0, h->cnt_asts = 0; i < cnt_lines; i++) {
+        now.lines[i] = lines[i].state;
+        if (!lines[i].state.parsed)
+            continue;
+        now.asts[h->cnt_asts] = *lines[i].ast;
+        /* The text of the line is freed after the compile, the next one points the span to its own text */
+        if (lines[i].state.has_span)
+            now.asts[h->cnt_asts].dir_inst.direct.span.line = NULL;
+        h->cnt_asts++;
+    }
+    for (node = *symbol_head, i = 0; node != NULL; node = get_next(node), i++) {
+        strncpy(now.symbols[i].name, get_symbol_name((symbol_node *)get_data(node)), MAX_SYMBOL_LENGTH - 1);
+        now.symbols[i].address = get_address((symbol_node *)get_data(node));
+        now.symbols[i].type = get_type((symbol_node *)get_data(node));
+    }
+    memcpy(now.instruction, instruction, h->total_ic * sizeof(int));
+
+    clear_state(st);
+    *st = now;
+    index_symbols(st);
+}
+
+/* Writes the state to the file */
+static void save_state(char *path, inc_state *st) {
+    char *tmp_path;
+    FILE *fp;
+
+    /* A compile which stops in the middle leaves the old state */
+    tmp_path = (char *)asm_malloc(strlen(path) + 5);
+    valid_allocate(tmp_path);
+    sprintf(tmp_path, "%s.tmp", path);
+    if ((fp = fopen(tmp_path, "wb")) == NULL) {
+        asm_free(tmp_path);
+        return;
+    }
+    state_check(st, st->header.check);
+    fwrite(&st->header, sizeof(state_header), 1, fp);
+    fwrite(st->lines, sizeof(line_state), st->header.cnt_lines, fp);
+    fwrite(st->asts, sizeof(syntax_ast), st->header.cnt_asts, fp);
+    fwrite(st->symbols, sizeof(symbol_state), st->header.cnt_symbols, fp);
+    fwrite(st->instruction, sizeof(int), st->header.total_ic, fp);
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+        remove(tmp_path);
+    asm_free(tmp_path);
+}
+
+/* Frees the state */
+static void clear_state(inc_state *st) {
+    asm_free(st->lines);
+    asm_free(st->asts);
+    asm_free(st->symbols);
+    asm_free(st->symbol_index);
+    memset(st, 0, sizeof(inc_state));
+}
+
+/* Hashes the lines, the parsed lines, the symbols and the instruction words of the state */
+static void state_check(inc_state *st, unsigned long check[2]) {
+    check[0] = 2166136261UL;
+    check[1] = 5381UL;
+    hash_text((char *)st->lines, (long)st->header.cnt_lines * sizeof(line_state), check);
+    hash_text((char *)st->asts, (long)st->header.cnt_asts * sizeof(syntax_ast), check);
+    hash_text((char *)st->symbols, (long)st->header.cnt_symbols * sizeof(symbol_state), check);
+    hash_text((char *)st->instruction, (long)st->header.total_ic * sizeof(int), check);
+}
+
+/* Checks if a parsed line of a state file can be used, its fields are in range and its strings end */
+static bool ast_valid(syntax_ast *sa, line_state *line) {
+    direct_ast *dir = &sa->dir_inst.direct;
+    instruct_ast *inst = &sa->dir_inst.instruct;
+    int code_words, data_words, i;
+
+    if (memchr(sa->syntax_error, '\0', sizeof(sa->syntax_error)) == NULL ||
+        memchr(sa->label_name, '\0', sizeof(sa->label_name)) == NULL)
+        return FALSE;
+    /* A line with an error only shows the error */
+    if (sa->syntax_error[0] != '\0')
+        return !line->encoded && !line->has_span && line->code_words == 0 && line->data_words == 0;
+    if (sa->opt_ast == instruct) {
+        if (line->has_span || (int)inst->inst_opt < instruct_mov || (int)inst->inst_opt > instruct_stop)
+            return FALSE;
+        for (i = 0; i < 2; i++) {
+            if (inst->op_met[i] != zero_op && inst->op_met[i] != num_op && inst->op_met[i] != label_op &&
+                inst->op_met[i] != reg_num_op)
+                return FALSE;
+            if (inst->op_met[i] == label_op && memchr(inst->op_opt[i].symbol, '\0', sizeof(inst->op_opt[i].symbol)) == NULL)
+                return FALSE;
+        }
+    } else if (sa->opt_ast == direct) {
+        /* The state keeps no pointer, a span is pointed to the text of the line when it is reused */
+        if (dir->span.line != NULL)
+            return FALSE;
+        switch (dir->dir_opt) {
+            case opt_entry:
+            case opt_extern:
+                if (line->has_span || memchr(dir->direct_params.symbol, '\0', sizeof(dir->direct_params.symbol)) == NULL)
+                    return FALSE;
+                break;
+            case opt_data:
+                if (dir->direct_params.data_s.cnt_data < 0 ||
+                    (!line->has_span && dir->direct_params.data_s.cnt_data > MAX_DATA_OPERANDS))
+                    return FALSE;
+                break;
+            case opt_string:
+                if (!line->has_span)
+                    return FALSE;
+                break;
+            default:
+                return FALSE;
+        }
+        /* The span must be inside the line it is read from */
+        if (line->has_span && (dir->span.start < 0 || dir->span.len < 0 || dir->span.start > line->length - dir->span.len))
+            return FALSE;
+    } else {
+        return FALSE;
+    }
+    /* The words of the line must be the words of its ast, or the addresses of the lines after it are wrong */
+    line_words(sa, &code_words, &data_words);
+    return code_words == line->code_words && data_words == line->data_words;
+}
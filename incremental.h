@@ -0,0 +1,28 @@
+#ifndef _INCREMENTAL_H_
+#define _INCREMENTAL_H_
+
+/* Incremental mode: the state of the last compile of a file is kept next to its
+ * outputs (<name>.inc): a hash of every line of the am_file, the parsed lines,
+ * their addresses, the symbol table and the instruction words.
+ *
+ * On the next compile the lines which didn't change at the start and at the end
+ * of the file are reused, only the edited lines between them are parsed. The
+ * lines after the edit move by the change in the words of the edited lines.
+ * A reused instruction keeps its words unless a symbol it uses moved, is new
+ * or is extern, then it is encoded again. The output is the same as a full compile. */
+
+typedef struct inc_state inc_state;
+
+/* compiles the am_file, reusing the state of the last compile */
+void compile_incremental(char *file_name);
+
+/* Creates an empty state, the first compile with it compiles every line */
+inc_state *state_create();
+
+/* compiles the am_file, reusing the state, which is replaced by the state of this compile */
+void compile_with_state(char *file_name, inc_state *st);
+
+/* Frees the state */
+void state_destroy(inc_state *st);
+
+#endif
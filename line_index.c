@@ -0,0 +1,192 @@
+/* line_index.c splits the am text to lines and keeps the lines of a whole file in memory */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "line_index.h"
+#include "stream.h"
+#include "options.h"
+
+/*** functions prototypes ***/
+
+/* Sends the collected line to the handler */
+static void end_line(line_splitter *ls);
+
+/* Doubles the buffer of the line, the chars collected are kept */
+static void grow_line(line_splitter *ls);
+
+/* Adds a line to the index */
+static void add_line(char *line, int line_number, bool too_long, void *arg);
+
+
+/* Prepares the splitter to send lines to the handler */
+void splitter_init(line_splitter *ls, line_handler handler, void *arg) {
+    ls->text = ls->line;
+    ls->size = MAX_LINE_LENGTH;
+    ls->len = 0;
+    ls->line_number = 0;
+    ls->discard = FALSE;
+    ls->handler = handler;
+    ls->arg = arg;
+}
+
+/* Splits the next size bytes of the text */
+void splitter_feed(line_splitter *ls, const char *bytes, int size) {
+    int i;
+
+    for (i = 0; i < size; i++) {
+        /* Drop the rest of a long line */
+        if (ls->discard) {
+            if (bytes[i] == '\n')
+                ls->discard = FALSE;
+            continue;
+        }
+        /* With --long-lines a line ends only at a new line */
+        if (options.long_lines) {
+            if (ls->len == ls->size - 1)
+                grow_line(ls);
+            ls->text[ls->len++] = bytes[i];
+            if (bytes[i] == '\n')
+                end_line(ls);
+            continue;
+        }
+        ls->text[ls->len++] = bytes[i];
+        /* A line ends at a new line or when the buffer is full, as with fgets */
+        if (bytes[i] == '\n' || ls->len == MAX_LINE_LENGTH - 1)
+            end_line(ls);
+    }
+}
+
+/* Sends the last line, if it has no new line, and frees the buffer of the long lines */
+void splitter_finish(line_splitter *ls) {
+    if (ls->len > 0)
+        end_line(ls);
+    if (ls->text != ls->line)
+        asm_free(ls->text);
+    ls->text = ls->line;
+    ls->size = MAX_LINE_LENGTH;
+}
+
+/* Sends the collected line to the handler */
+static void end_line(line_splitter *ls) {
+    bool too_long;
+
+    ls->text[ls->len] = '\0';
+    too_long = !options.long_lines && ls->len == MAX_LINE_LENGTH - 1 && ls->text[MAX_LINE_LENGTH - 2] != '\n';
+    if (too_long)
+        ls->discard = TRUE;
+    ls->len = 0;
+    ls->handler(ls->text, ++ls->line_number, too_long, ls->arg);
+}
+
+/* Doubles the buffer of the line, the chars collected are kept */
+static void grow_line(line_splitter *ls) {
+    char *text = (char *)asm_malloc(2 * ls->size);
+
+    valid_allocate(text);
+    memcpy(text, ls->text, ls->len);
+    if (ls->text != ls->line)
+        asm_free(ls->text);
+    ls->text = text;
+    ls->size *= 2;
+}
+
+/* Reads the next line of the file into the buffer, returns 0 at the end of the file */
+int read_line(FILE *fp, char **buffer, int *size) {
+    int len;
+
+    if (*buffer == NULL) {
+        *size = MAX_LINE_LENGTH;
+        *buffer = (char *)asm_malloc(*size);
+        valid_allocate(*buffer);
+    }
+    if (!options.long_lines)
+        return fgets(*buffer, MAX_LINE_LENGTH, fp) != NULL;
+
+    if (fgets(*buffer, *size, fp) == NULL)
+        return 0;
+    /* The buffer is full and the line goes on, read the rest of it after the chars read */
+    len = strlen(*buffer);
+    while (len == *size - 1 && (*buffer)[len - 1] != '\n') {
+        *size *= 2;
+        *buffer = (char *)asm_realloc(*buffer, *size);
+        valid_allocate(*buffer);
+        if (fgets(*buffer + len, *size - len, fp) == NULL)
+            break;
+        len += strlen(*buffer + len);
+    }
+    return 1;
+}
+
+/* Checks if the line read by read_line was cut, the rest of the line is still in the file */
+bool line_too_long(char *line) {
+    if (options.long_lines)
+        return FALSE;
+    return strlen(line) == MAX_LINE_LENGTH - 1 && line[MAX_LINE_LENGTH - 2] != '\n';
+}
+
+/* Loads the file and splits it to lines, returns 0 if the file can't be read */
+int load_line_index(char *file_name, line_index *index) {
+    FILE *fp;
+    char *text;
+    long size, i, cnt_newlines = 0;
+    line_splitter ls;
+
+    index->buffer = NULL;
+    index->used = 0;
+    index->lines = NULL;
+    index->cnt_lines = 0;
+
+    fp = open_input(file_name);
+    if (fp == NULL)
+        return 0;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+
+    text = (char *)asm_malloc(size + 1);
+    valid_allocate(text);
+    size = fread(text, 1, size, fp);
+    fclose(fp);
+
+    /* A line ends at a new line or at the end of the text, and keeps at most its chars of the text */
+    for (i = 0; i < size; i++) {
+        if (text[i] == '\n')
+            cnt_newlines++;
+    }
+    index->buffer = (char *)asm_malloc(size + cnt_newlines + 2);
+    index->lines = (line_entry *)asm_malloc((cnt_newlines + 2) * sizeof(line_entry));
+    valid_allocate(index->buffer);
+    valid_allocate(index->lines);
+
+    splitter_init(&ls, add_line, index);
+    splitter_feed(&ls, text, size);
+    splitter_finish(&ls);
+    asm_free(text);
+    return 1;
+}
+
+/* Adds a line to the index */
+static void add_line(char *line, int line_number, bool too_long, void *arg) {
+    line_index *index = (line_index *)arg;
+    line_entry *entry = &index->lines[index->cnt_lines];
+    long len = strlen(line) + 1;
+
+    /* The lines are stored one after the other */
+    entry->text = index->buffer + index->used;
+    memcpy(entry->text, line, len);
+    index->used += len;
+    entry->line_number = line_number;
+    entry->too_long = too_long;
+    index->cnt_lines++;
+}
+
+/* Frees the lines of the index */
+void clear_line_index(line_index *index) {
+    asm_free(index->buffer);
+    asm_free(index->lines);
+    index->buffer = NULL;
+    index->lines = NULL;
+    index->used = 0;
+    index->cnt_lines = 0;
+}
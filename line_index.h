@@ -0,0 +1,63 @@
+#ifndef _LINE_INDEX_H_
+#define _LINE_INDEX_H_
+
+#include <stdio.h>
+#include "define.h"
+
+/* Splits text to lines exactly like the read_line loops of the iterations do:
+ * a line ends at a new line or after MAX_LINE_LENGTH - 1 chars, and the rest
+ * of a line which is too long is dropped. With --long-lines a line ends only
+ * at a new line, however long it is. */
+
+/* receives a line, too_long is set if the line is longer than the allowed length */
+typedef void (*line_handler)(char *line, int line_number, bool too_long, void *arg);
+
+typedef struct {
+    char line[MAX_LINE_LENGTH]; /* the line being collected */
+    char *text;                 /* line, or a larger buffer for a long line with --long-lines */
+    int size;                   /* size of text */
+    int len;                    /* chars in text */
+    int line_number;            /* number of the last line handled */
+    bool discard;               /* dropping the rest of a long line */
+    line_handler handler;
+    void *arg;
+} line_splitter;
+
+/* a line of a loaded file */
+typedef struct {
+    char *text;        /* the line, including the new line */
+    int line_number;
+    bool too_long;
+} line_entry;
+
+/* all the lines of a file, loaded at once */
+typedef struct {
+    char *buffer;      /* holds the text of all the lines */
+    long used;         /* chars of buffer taken by the lines and their terminators */
+    line_entry *lines;
+    int cnt_lines;
+} line_index;
+
+/* Prepares the splitter to send lines to the handler */
+void splitter_init(line_splitter *ls, line_handler handler, void *arg);
+
+/* Splits the next size bytes of the text */
+void splitter_feed(line_splitter *ls, const char *bytes, int size);
+
+/* Sends the last line, if it has no new line, and frees the buffer of the long lines */
+void splitter_finish(line_splitter *ls);
+
+/* Reads the next line of the file into the buffer, which is allocated on the first call, returns 0 at the end of the file.
+ * As with fgets a line ends after MAX_LINE_LENGTH - 1 chars, with --long-lines the buffer grows to hold the whole line */
+int read_line(FILE *fp, char **buffer, int *size);
+
+/* Checks if the line read by read_line was cut, the rest of the line is still in the file */
+bool line_too_long(char *line);
+
+/* Loads the file and splits it to lines, returns 0 if the file can't be read */
+int load_line_index(char *file_name, line_index *index);
+
+/* Frees the lines of the index */
+void clear_line_index(line_index *index);
+
+#endif
@@ -21,8 +21,8 @@ void add_node(node_ref head, void *data, int size)
 	void *buffer; /* data buffer */
 
     /* Creates the data buffer and the node */
-    buffer = calloc(1, size);
-	new_node = (node_ptr)calloc(1, sizeof(node_def));
+    buffer = asm_calloc(1, size);
+	new_node = (node_ptr)asm_calloc(1, sizeof(node_def));
 	
 	/* Checks if buffer and node were created successfully*/
         valid_allocate(buffer);
@@ -47,6 +47,24 @@ void add_node(node_ref head, void *data, int size)
     temp->next = new_node;
 } /* end of add_node */
 
+/* Moves all the nodes of the second list to the end of the first list */
+void append_list(node_ref head, node_ref tail)
+{
+	node_ptr temp; /* iterator */
+
+	if (*tail == NULL)
+		return;
+	if (*head == NULL) {
+		*head = *tail;
+	} else {
+		temp = *head;
+		while (temp->next != NULL)
+			temp = temp->next;
+		temp->next = *tail;
+	}
+	*tail = NULL;
+} /* end of append_list */
+
 /* Clears a list */
 void clear_list(node_ptr *head)
 {
@@ -9,6 +9,9 @@ typedef struct node node_def, *node_ptr, **node_ref;
 /* Creates a new node and adds it to the end of the list */
 void add_node(node_ref head, void *data, int size);
 
+/* Moves all the nodes of the second list to the end of the first list */
+void append_list(node_ref head, node_ref tail);
+
 /* Clears a list */
 void clear_list(node_ptr *head);
 
@@ -1,41 +1,145 @@
 #include "compile.h"
 #include "pre_processor.h"
+#include "pipeline.h"
+#include "parallel.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include "incremental.h"
+#include "watch.h"
+#include "emit.h"
+#include "stream.h"
+#include "async_io.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "options.h"
 
-int ic;
-int dc;
-int has_error;
-int cnt_line;
-char *file_am_name;
+per_thread int ic;
+per_thread int dc;
+per_thread int has_error;
+per_thread int cnt_line;
+per_thread char *file_am_name;
+
+/* Compiles one file */
+static void assemble_file(char *file_name);
+
+/* Compiles one file in the mode of the options */
+static void assemble_modes(char *file_name, char *asfile_name);
 
 int main(int argc, char* argv[]){
-    int i; /* arg index */
-	
-    char *asfile_name;
+    int i, status; /* arg index */
+    char key[CACHE_KEY_SIZE];
+    diag_buffer diag = {0}, *prev = NULL;
     
+	argc = parse_options(argc, argv);
+	if (argc < 0 || (options.emit != NULL && !emitters_valid(options.emit)))
+		exit(1);
+	if (options.alloc_report)
+		alloc_track();
+	/* The peephole pass needs all the parsed lines of a file, which only the parallel mode keeps */
+	if (options.peephole && (options.pipeline || options.incremental || options.watch || options.stdio || options.serve != NULL)) {
+		diag_printf("Error: --peephole can't be used with --pipeline, --incremental, --watch, --stdio or --serve\n");
+		exit(1);
+	}
+
+	/* The server gets the files from its clients */
+	if (options.serve != NULL)
+		return serve(options.serve);
+
+	/* The source comes from stdin, the argument only names it */
+	if (options.stdio)
+		return assemble_stream(argc > 1 ? argv[1] : "stdin");
+
 	/* If no filename received */
 	if (argc < 2)
 	{
 		printf("No input file received.");
 		exit(1);
 	}
+
+	/* The watch mode keeps the state of the files between the compiles */
+	if (options.watch)
+		return watch_files(argv + 1, argc - 1);
 	
+	/* The reads and writes of the files go to the I/O backend */
+	if (options.io != NULL && !async_start(options.io))
+		exit(1);
+	if (options.trace != NULL)
+		trace_start(options.trace);
+	if (options.stats || options.stats_json != NULL || options.trace != NULL)
+		stats_start(argv + 1, argc - 1);
+
+	/* Several workers share the files, large files are split to tasks */
+	if (options.jobs > 1 && !options.pipeline && !options.incremental) {
+		status = assemble_batch(argv + 1, argc - 1, options.jobs);
+		async_stop();
+		stats_report();
+		alloc_report();
+		return status;
+	}
+
+	/* The sources are read in the background while the first files are compiled */
+	if (async_active())
+		async_prefetch(argv + 1, argc - 1);
+
 	/* Sends all files to compile */
 	for (i = 1; i < argc; i++)
 	{
-		asfile_name = name_file(argv[i],INPUT_FILE);
-       
-		if(!pre_processor(argv[i])){
-                   printf("\nErrors in Macros declarations and implematation, failed to process file '%s.\n",asfile_name);
-                    continue;
-                }
-		compile(argv[i]);
-        
-                free(asfile_name);
-        }
+		/* An unchanged source is restored from the cache */
+		if (cache_restore(argv[i], key))
+			continue;
+		if (key[0] != '\0')
+			prev = diag_redirect(&diag);
+
+		assemble_file(argv[i]);
+
+		/* The cache keeps the diagnostics with the outputs */
+		if (key[0] != '\0') {
+			diag_redirect(prev);
+			cache_store(argv[i], key, &diag);
+			diag_flush(&diag);
+		}
+		async_release(argv[i]);
+	}
 	
+	async_stop();
+	stats_report();
+	alloc_report();
 	return 0;
 }
 
+/* Compiles one file */
+static void assemble_file(char *file_name) {
+	char *asfile_name = name_file(file_name, INPUT_FILE);
+
+	probe1(file_start, file_name);
+	assemble_modes(file_name, asfile_name);
+	probe1(file_end, file_name);
+	asm_free(asfile_name);
+}
+
+/* Compiles one file in the mode of the options */
+static void assemble_modes(char *file_name, char *asfile_name) {
+	/* The pipelined mode runs both stages at once */
+	if (options.pipeline) {
+		if (!compile_pipelined(file_name))
+			diag_printf("\nErrors in Macros declarations and implematation, failed to process file '%s.\n",asfile_name);
+		return;
+	}
+
+	if(!pre_processor(file_name)){
+		diag_printf("\nErrors in Macros declarations and implematation, failed to process file '%s.\n",asfile_name);
+		return;
+	}
+	if (options.incremental)
+		compile_incremental(file_name);
+	else if (options.parallel || options.peephole)
+		compile_parallel(file_name);
+	else
+		compile(file_name);
+}
+
 
 
 
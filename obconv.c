@@ -0,0 +1,176 @@
+/* obconv.c converts between the text object files (.ob, .ent, .ext) and the binary object file (.obj).
+ *
+ *   obconv --to-binary name   reads name.ob, name.ent and name.ext, writes name.obj
+ *   obconv --to-text name     reads name.obj, writes name.ob and name.ent, name.ext if they aren't empty
+ *
+ * The text files it writes are the same as the ones the assembler writes. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "objfile.h"
+
+#define MAX_WORDS 4096
+#define MAX_SYMBOLS 4096
+#define MAX_NAME 4096
+
+static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*** functions prototypes ***/
+
+/* Converts the text files of name to name.obj, returns the exit status */
+static int to_binary(char *name);
+
+/* Converts name.obj to the text files of name, returns the exit status */
+static int to_text(char *name);
+
+/* Reads the symbols of an .ent or .ext file, a file which doesn't exist has none */
+static int read_symbols(char *path, obj_symbol symbols[], char names[][OBJ_NAME_SIZE]);
+
+/* Writes the symbols of a table to an .ent or .ext file */
+static int write_symbols(char *path, const obj_file *obj,
+                         const char *(*symbol)(const obj_file *, int, unsigned int *), int cnt);
+
+/* Decodes a word of 2 base 64 digits, returns -1 if it isn't one */
+static int decode_word(const char *digits);
+
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--to-binary") == 0)
+        return to_binary(argv[2]);
+    if (argc == 3 && strcmp(argv[1], "--to-text") == 0)
+        return to_text(argv[2]);
+    printf("Usage: obconv --to-binary name | --to-text name\n");
+    return 1;
+}
+
+/* Converts the text files of name to name.obj, returns the exit status */
+static int to_binary(char *name) {
+    static int words[MAX_WORDS];
+    static obj_symbol entries[MAX_SYMBOLS], externs[MAX_SYMBOLS];
+    static char entry_names[MAX_SYMBOLS][OBJ_NAME_SIZE], extern_names[MAX_SYMBOLS][OBJ_NAME_SIZE];
+    char path[MAX_NAME + 8], digits[8];
+    int ic, dc, i, cnt_entries, cnt_externs, ok;
+    FILE *fp;
+
+    if (strlen(name) > MAX_NAME)
+        return 1;
+    sprintf(path, "%s.ob", name);
+    if ((fp = fopen(path, "r")) == NULL) {
+        printf("Error: can't open file: %s\n", path);
+        return 1;
+    }
+    ok = fscanf(fp, "%d %d", &ic, &dc) == 2 && ic >= 0 && dc >= 0 && ic + dc <= MAX_WORDS;
+    for (i = 0; ok && i < ic + dc; i++)
+        ok = fscanf(fp, "%7s", digits) == 1 && (words[i] = decode_word(digits)) >= 0;
+    fclose(fp);
+    if (!ok) {
+        printf("Error: %s is not an object file\n", path);
+        return 1;
+    }
+
+    sprintf(path, "%s.ent", name);
+    cnt_entries = read_symbols(path, entries, entry_names);
+    sprintf(path, "%s.ext", name);
+    cnt_externs = read_symbols(path, externs, extern_names);
+    if (cnt_entries < 0 || cnt_externs < 0) {
+        printf("Error: bad symbol file of %s\n", name);
+        return 1;
+    }
+
+    sprintf(path, "%s.obj", name);
+    if ((fp = fopen(path, "wb")) == NULL) {
+        printf("Error: can't create file: %s\n", path);
+        return 1;
+    }
+    ok = obj_write(fp, ic, dc, words, entries, cnt_entries, externs, cnt_externs);
+    return fclose(fp) == 0 && ok ? 0 : 1;
+}
+
+/* Converts name.obj to the text files of name, returns the exit status */
+static int to_text(char *name) {
+    char path[MAX_NAME + 8];
+    obj_file obj;
+    obj_segment code, data;
+    FILE *fp;
+    int i, ok;
+
+    if (strlen(name) > MAX_NAME)
+        return 1;
+    sprintf(path, "%s.obj", name);
+    if (!obj_open(path, &obj)) {
+        printf("Error: %s is not an object file\n", path);
+        return 1;
+    }
+
+    /* The layout of the .ob file of the assembler */
+    sprintf(path, "%s.ob", name);
+    if ((fp = fopen(path, "w")) == NULL) {
+        printf("Error: can't create file: %s\n", path);
+        obj_close(&obj);
+        return 1;
+    }
+    code = obj_code(&obj);
+    data = obj_data(&obj);
+    fprintf(fp, "\n%d %d", obj.ic, obj.dc);
+    for (i = 0; i < code.cnt; i++)
+        fprintf(fp, "\n%c%c", base64[obj_word(code, i) >> 6], base64[obj_word(code, i) & 0x3f]);
+    for (i = 0; i < data.cnt; i++)
+        fprintf(fp, "\n%c%c", base64[obj_word(data, i) >> 6], base64[obj_word(data, i) & 0x3f]);
+    ok = fclose(fp) == 0;
+
+    sprintf(path, "%s.ent", name);
+    ok = write_symbols(path, &obj, obj_entry, obj.cnt_entries) && ok;
+    sprintf(path, "%s.ext", name);
+    ok = write_symbols(path, &obj, obj_extern, obj.cnt_externs) && ok;
+    obj_close(&obj);
+    return ok ? 0 : 1;
+}
+
+/* Reads the symbols of an .ent or .ext file, a file which doesn't exist has none */
+static int read_symbols(char *path, obj_symbol symbols[], char names[][OBJ_NAME_SIZE]) {
+    FILE *fp = fopen(path, "r");
+    unsigned int address;
+    int cnt = 0;
+
+    if (fp == NULL)
+        return 0;
+    while (cnt < MAX_SYMBOLS && fscanf(fp, "%31s %u", names[cnt], &address) == 2) {
+        symbols[cnt].name = names[cnt];
+        symbols[cnt++].address = address;
+    }
+    if (!feof(fp) && fscanf(fp, " ") != EOF)
+        cnt = -1;
+    fclose(fp);
+    return cnt;
+}
+
+/* Writes the symbols of a table to an .ent or .ext file, like the assembler does */
+static int write_symbols(char *path, const obj_file *obj,
+                         const char *(*symbol)(const obj_file *, int, unsigned int *), int cnt) {
+    unsigned int address;
+    const char *symbol_name;
+    FILE *fp;
+    int i;
+
+    if (cnt == 0)
+        return 1;
+    if ((fp = fopen(path, "w")) == NULL) {
+        printf("Error: can't create file: %s\n", path);
+        return 0;
+    }
+    for (i = 0; i < cnt; i++) {
+        symbol_name = symbol(obj, i, &address);
+        fprintf(fp, "\n%.*s\t%u", OBJ_NAME_SIZE - 1, symbol_name, address);
+    }
+    return fclose(fp) == 0;
+}
+
+/* Decodes a word of 2 base 64 digits, returns -1 if it isn't one */
+static int decode_word(const char *digits) {
+    const char *high, *low;
+
+    if (strlen(digits) != 2 || (high = strchr(base64, digits[0])) == NULL || (low = strchr(base64, digits[1])) == NULL)
+        return -1;
+    return (int)(high - base64) << 6 | (int)(low - base64);
+}
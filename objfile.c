@@ -0,0 +1,223 @@
+/*** objfile.c writes the binary object files and maps them for reading ***/
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "objfile.h"
+
+#define ARE_RELOCATABLE 2    /* the A,R,E bits of a word holding a local address */
+
+/*** functions prototypes ***/
+
+/* Writes a 32 bits number, little endian */
+static void put32(unsigned char *p, unsigned long value);
+
+/* Reads a 32 bits number, little endian */
+static unsigned long get32(const unsigned char *p);
+
+/* Writes the records of a symbol table */
+static void put_symbols(FILE *fp, const obj_symbol symbols[], int cnt);
+
+/* Reads a record of a symbol table */
+static const char *get_symbol(const unsigned char *table, int index, unsigned int *address);
+
+/* Checks that the name of every record of a symbol table ends inside the record */
+static int names_valid(const unsigned char *table, int cnt);
+
+
+/* Writes an object file, returns 0 on a write error */
+int obj_write(FILE *fp, int ic, int dc, const int words[],
+              const obj_symbol entries[], int cnt_entries, const obj_symbol externs[], int cnt_externs) {
+    unsigned char header[OBJ_HEADER_SIZE], packed[3], record[4];
+    long words_size = (ic + dc + 1) / 2 * 3;
+    long entries_at = OBJ_HEADER_SIZE + words_size;
+    long externs_at = entries_at + (long)cnt_entries * OBJ_SYMBOL_SIZE;
+    long relocations_at = externs_at + (long)cnt_externs * OBJ_SYMBOL_SIZE;
+    int i, cnt_relocations = 0;
+
+    for (i = 0; i < ic; i++) {
+        if ((words[i] & 3) == ARE_RELOCATABLE)
+            cnt_relocations++;
+    }
+    memset(header, 0, sizeof(header));
+    memcpy(header, OBJ_MAGIC, 4);
+    put32(header + 4, OBJ_VERSION);
+    put32(header + 8, ic);
+    put32(header + 12, dc);
+    put32(header + 16, OBJ_HEADER_SIZE);
+    put32(header + 20, entries_at);
+    put32(header + 24, cnt_entries);
+    put32(header + 28, externs_at);
+    put32(header + 32, cnt_externs);
+    put32(header + 36, relocations_at);
+    put32(header + 40, cnt_relocations);
+    put32(header + 44, relocations_at + 4L * cnt_relocations);
+    fwrite(header, 1, sizeof(header), fp);
+
+    /* Two words in three bytes */
+    for (i = 0; i < ic + dc; i += 2) {
+        unsigned int first = words[i] & OBJ_WORD_MASK;
+        unsigned int second = i + 1 < ic + dc ? words[i + 1] & OBJ_WORD_MASK : 0;
+
+        packed[0] = first & 0xff;
+        packed[1] = (first >> 8) | ((second & 0xf) << 4);
+        packed[2] = second >> 4;
+        fwrite(packed, 1, 3, fp);
+    }
+    put_symbols(fp, entries, cnt_entries);
+    put_symbols(fp, externs, cnt_externs);
+    for (i = 0; i < ic; i++) {
+        if ((words[i] & 3) == ARE_RELOCATABLE) {
+            put32(record, i);
+            fwrite(record, 1, 4, fp);
+        }
+    }
+    return !ferror(fp);
+}
+
+/* Maps an object file and checks its header, returns 0 if it isn't a valid object file */
+int obj_open(const char *path, obj_file *obj) {
+    struct stat st;
+    const unsigned char *map;
+    unsigned long words_at, entries_at, externs_at, relocations_at;
+    int fd = open(path, O_RDONLY);
+
+    memset(obj, 0, sizeof(obj_file));
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &st) != 0 || st.st_size < OBJ_HEADER_SIZE) {
+        close(fd);
+        return 0;
+    }
+    map = (const unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == (const unsigned char *)MAP_FAILED)
+        return 0;
+    obj->map = map;
+    obj->size = st.st_size;
+
+    obj->ic = get32(map + 8);
+    obj->dc = get32(map + 12);
+    words_at = get32(map + 16);
+    entries_at = get32(map + 20);
+    obj->cnt_entries = get32(map + 24);
+    externs_at = get32(map + 28);
+    obj->cnt_externs = get32(map + 32);
+    relocations_at = get32(map + 36);
+    obj->cnt_relocations = get32(map + 40);
+
+    /* Every table must be inside the file */
+    if (memcmp(map, OBJ_MAGIC, 4) != 0 || get32(map + 4) != OBJ_VERSION || get32(map + 44) != obj->size ||
+        obj->ic < 0 || obj->dc < 0 || obj->cnt_entries < 0 || obj->cnt_externs < 0 || obj->cnt_relocations < 0 ||
+        words_at + ((unsigned long)obj->ic + (unsigned long)obj->dc + 1) / 2 * 3 > obj->size ||
+        entries_at + (unsigned long)obj->cnt_entries * OBJ_SYMBOL_SIZE > obj->size ||
+        externs_at + (unsigned long)obj->cnt_externs * OBJ_SYMBOL_SIZE > obj->size ||
+        relocations_at + 4UL * obj->cnt_relocations > obj->size ||
+        !names_valid(map + entries_at, obj->cnt_entries) || !names_valid(map + externs_at, obj->cnt_externs)) {
+        obj_close(obj);
+        return 0;
+    }
+    obj->words = map + words_at;
+    obj->entries = map + entries_at;
+    obj->externs = map + externs_at;
+    obj->relocations = map + relocations_at;
+    return 1;
+}
+
+/* Unmaps the object file */
+void obj_close(obj_file *obj) {
+    if (obj->map != NULL)
+        munmap((void *)obj->map, obj->size);
+    memset(obj, 0, sizeof(obj_file));
+}
+
+/* The instruction words */
+obj_segment obj_code(const obj_file *obj) {
+    obj_segment seg;
+    seg.words = obj->words;
+    seg.first = 0;
+    seg.cnt = obj->ic;
+    return seg;
+}
+
+/* The data words */
+obj_segment obj_data(const obj_file *obj) {
+    obj_segment seg;
+    seg.words = obj->words;
+    seg.first = obj->ic;
+    seg.cnt = obj->dc;
+    return seg;
+}
+
+/* A word of a segment */
+int obj_word(obj_segment seg, int index) {
+    int i = seg.first + index;
+    const unsigned char *p = seg.words + i / 2 * 3;
+
+    if (i % 2 == 0)
+        return p[0] | ((p[1] & 0xf) << 8);
+    return (p[1] >> 4) | (p[2] << 4);
+}
+
+/* A symbol of the entry table: returns its name and sets address */
+const char *obj_entry(const obj_file *obj, int index, unsigned int *address) {
+    return get_symbol(obj->entries, index, address);
+}
+
+/* A reference of the extern table: returns its name and sets address */
+const char *obj_extern(const obj_file *obj, int index, unsigned int *address) {
+    return get_symbol(obj->externs, index, address);
+}
+
+/* Index of an instruction word which holds the address of a symbol of this file */
+int obj_relocation(const obj_file *obj, int index) {
+    return get32(obj->relocations + 4 * index);
+}
+
+/* Writes a 32 bits number, little endian */
+static void put32(unsigned char *p, unsigned long value) {
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+/* Reads a 32 bits number, little endian */
+static unsigned long get32(const unsigned char *p) {
+    return p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/* Writes the records of a symbol table */
+static void put_symbols(FILE *fp, const obj_symbol symbols[], int cnt) {
+    unsigned char record[OBJ_SYMBOL_SIZE];
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        memset(record, 0, sizeof(record));
+        strncpy((char *)record, symbols[i].name, OBJ_NAME_SIZE - 1);
+        put32(record + OBJ_NAME_SIZE, symbols[i].address);
+        fwrite(record, 1, sizeof(record), fp);
+    }
+}
+
+/* Reads a record of a symbol table, the name is terminated by the padding */
+static const char *get_symbol(const unsigned char *table, int index, unsigned int *address) {
+    const unsigned char *record = table + (long)index * OBJ_SYMBOL_SIZE;
+
+    if (address != NULL)
+        *address = get32(record + OBJ_NAME_SIZE);
+    return (const char *)record;
+}
+
+/* Checks that the name of every record of a symbol table ends inside the record */
+static int names_valid(const unsigned char *table, int cnt) {
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        if (memchr(table + (long)i * OBJ_SYMBOL_SIZE, '\0', OBJ_NAME_SIZE) == NULL)
+            return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,84 @@
+#ifndef _OBJFILE_H_
+#define _OBJFILE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Binary object file (.obj), the same program as the .ob, .ent and .ext files together.
+ * All the numbers are 32 bits little endian, the file starts with a header:
+ *
+ *   offset  0  magic "AOBJ"
+ *           4  version
+ *           8  ic, number of instruction words
+ *          12  dc, number of data words
+ *          16  offset of the words, the instruction words then the data words,
+ *              packed two 12 bit words in 3 bytes (low bits first)
+ *          20  offset and 24 number of entries
+ *          28  offset and 32 number of extern references
+ *          36  offset and 40 number of relocation records
+ *          44  size of the file
+ *
+ * An entry or an extern reference is a name of OBJ_NAME_SIZE bytes (padded with zeros)
+ * followed by its address. A relocation record is the index of an instruction word
+ * which holds the address of a symbol of this file.
+ *
+ * The reader maps the file and gives views into it, nothing is parsed or copied.
+ * This file and objfile.c don't depend on the rest of the assembler. */
+
+#define OBJ_MAGIC "AOBJ"
+#define OBJ_VERSION 1
+#define OBJ_HEADER_SIZE 48
+#define OBJ_NAME_SIZE 32
+#define OBJ_SYMBOL_SIZE (OBJ_NAME_SIZE + 4)
+#define OBJ_WORD_MASK 0xfff
+
+/* a symbol of the entry or extern table, for writing */
+typedef struct {
+    const char *name;
+    unsigned int address;
+} obj_symbol;
+
+/* a mapped object file */
+typedef struct {
+    const unsigned char *map;    /* the whole file */
+    size_t size;
+    int ic, dc;
+    const unsigned char *words;  /* packed words */
+    const unsigned char *entries, *externs;
+    const unsigned char *relocations;
+    int cnt_entries, cnt_externs, cnt_relocations;
+} obj_file;
+
+/* a range of words of an object file, the code or the data */
+typedef struct {
+    const unsigned char *words;  /* packed words of the file */
+    int first;                   /* index of the first word in the file */
+    int cnt;
+} obj_segment;
+
+/* Writes an object file, words holds the ic instruction words and then the dc data words.
+ * Returns 0 on a write error */
+int obj_write(FILE *fp, int ic, int dc, const int words[],
+              const obj_symbol entries[], int cnt_entries, const obj_symbol externs[], int cnt_externs);
+
+/* Maps an object file and checks its header, returns 0 if it isn't a valid object file */
+int obj_open(const char *path, obj_file *obj);
+
+/* Unmaps the object file */
+void obj_close(obj_file *obj);
+
+/* The instruction words and the data words */
+obj_segment obj_code(const obj_file *obj);
+obj_segment obj_data(const obj_file *obj);
+
+/* A word of a segment */
+int obj_word(obj_segment seg, int index);
+
+/* A symbol of the entry table or the extern table: returns its name (in the mapping) and sets address */
+const char *obj_entry(const obj_file *obj, int index, unsigned int *address);
+const char *obj_extern(const obj_file *obj, int index, unsigned int *address);
+
+/* Index of an instruction word which holds the address of a symbol of this file */
+int obj_relocation(const obj_file *obj, int index);
+
+#endif
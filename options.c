@@ -0,0 +1,101 @@
+/* options.c parses the command line options of the assembler */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "diag.h"
+
+asm_options options; /* options of the current run */
+
+/* types of values an option can receive */
+typedef enum {
+    opt_flag,   /* sets a bool, no value */
+    opt_number, /* the next argument is a positive int */
+    opt_text    /* the next argument is a string */
+} option_kind;
+
+typedef struct {
+    const char *name;   /* name of the option, including "--" */
+    option_kind kind;   /* type of the option value */
+    void *target;       /* where the value is stored */
+} option_lex;
+
+/* Define an array of option_lex structures to store all known options */
+static option_lex option_table[] = {
+    {"--pipeline", opt_flag, &options.pipeline},
+    {"--parallel", opt_flag, &options.parallel},
+    {"--incremental", opt_flag, &options.incremental},
+    {"--watch", opt_flag, &options.watch},
+    {"--binary", opt_flag, &options.binary},
+    {"--stdio", opt_flag, &options.stdio},
+    {"--emit", opt_text, &options.emit},
+    {"--jobs", opt_number, &options.jobs},
+    {"--out-dir", opt_text, &options.out_dir},
+    {"--serve", opt_text, &options.serve},
+    {"--cache", opt_text, &options.cache_dir},
+    {"--cache-size", opt_number, &options.cache_size},
+    {"--io", opt_text, &options.io},
+    {"--stats", opt_flag, &options.stats},
+    {"--stats-json", opt_text, &options.stats_json},
+    {"--trace", opt_text, &options.trace},
+    {"--alloc-report", opt_flag, &options.alloc_report},
+    {"--long-lines", opt_flag, &options.long_lines},
+    {"--dedup-data", opt_flag, &options.dedup_data},
+    {"--peephole", opt_flag, &options.peephole},
+    {NULL, opt_flag, NULL}
+};
+
+/*** functions prototypes ***/
+
+/* Find an option by name, returns NULL if not found */
+static option_lex *find_option(char *name);
+
+/* Removes the options from argv and returns the new number of arguments, -1 for an invalid option */
+int parse_options(int argc, char *argv[]) {
+    int i, cnt = 1;
+    option_lex *opt;
+
+    for (i = 1; i < argc; i++) {
+        /* Keep the file names in their original order */
+        if (strncmp(argv[i], "--", 2) != 0) {
+            argv[cnt++] = argv[i];
+            continue;
+        }
+        if ((opt = find_option(argv[i])) == NULL) {
+            diag_printf("Error: unknown option '%s'\n", argv[i]);
+            return -1;
+        }
+        switch (opt->kind) {
+            case opt_flag:
+                *(bool *)opt->target = TRUE;
+                break;
+            case opt_number:
+                if (i + 1 >= argc || atoi(argv[i + 1]) <= 0) {
+                    diag_printf("Error: option '%s' requires a positive number\n", argv[i]);
+                    return -1;
+                }
+                *(int *)opt->target = atoi(argv[++i]);
+                break;
+            case opt_text:
+                if (i + 1 >= argc) {
+                    diag_printf("Error: option '%s' requires a value\n", argv[i]);
+                    return -1;
+                }
+                *(char **)opt->target = argv[++i];
+                break;
+        }
+    }
+    argv[cnt] = NULL;
+    return cnt;
+}
+
+/* Find an option by name, returns NULL if not found */
+static option_lex *find_option(char *name) {
+    option_lex *opt;
+    for (opt = option_table; opt->name != NULL; opt++) {
+        if (strcmp(opt->name, name) == 0)
+            return opt;
+    }
+    return NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+#include "define.h"
+
+/* Command line options of the assembler, options start with "--" and may appear anywhere between the file names */
+
+typedef struct {
+    bool pipeline; /* run the macro expander, the parser and the encoder on separate threads */
+    bool parallel; /* parse the lines of a file on all cores */
+    bool incremental; /* reuse the lines which didn't change since the last compile */
+    bool watch;    /* compile the files again whenever they are saved */
+    bool binary;   /* write the binary object file too */
+    bool stdio;    /* read the source from stdin and write the outputs to stdout */
+    char *emit;    /* the output formats, separated by commas, NULL for the default */
+    int jobs;      /* number of threads, 0 for the number of cores */
+    char *out_dir; /* directory of the output files, NULL for the directory of the input */
+    char *serve;   /* path of the unix socket to serve requests on */
+    char *cache_dir; /* directory of the output cache, NULL for no cache */
+    char *io;      /* I/O backend, "uring" or "threads", NULL for blocking I/O */
+    bool stats;    /* print the times and the counters of the phases */
+    char *stats_json; /* file of the statistics in JSON, "-" for stdout */
+    char *trace;   /* file of the timeline of the phases, in the Chrome trace format */
+    bool alloc_report; /* print the allocations of every call site at the end */
+    int cache_size;  /* size limit of the cache in megabytes, 0 for the default */
+    bool long_lines; /* lines and directives of any length, instead of the limit of 80 chars */
+    bool dedup_data; /* keep one copy of the identical .data and .string blocks */
+    bool peephole;   /* remove the instructions which do nothing and shorten the ones with a shorter form */
+} asm_options;
+
+extern asm_options options;
+
+/* Removes the options from argv and returns the new number of arguments, -1 for an invalid option */
+int parse_options(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,462 @@
+/*** parallel.c parses and encodes the lines of one file on several threads ***/
+#include "compile.h"
+#include "line_index.h"
+#include "thread_pool.h"
+#include "diag.h"
+#include "stats.h"
+#include "parallel.h"
+#include "peephole.h"
+#include "options.h"
+
+extern per_thread int cnt_line;	/* line number to show in errors */
+extern per_thread bool has_error;	/* to prevent output file creation if an error was found */
+extern per_thread int ic;
+extern per_thread int dc;
+extern per_thread char *file_am_name;
+
+#define MIN_CHUNK_LINES 256   /* smaller chunks cost more than they save */
+#define CHUNKS_PER_JOB 4      /* more chunks than threads, for balance */
+
+/* a line of the am_file after the parsing */
+typedef struct {
+    bool parsed;       /* FALSE for comments, empty lines and long lines */
+    peep_change peephole;  /* the change of --peephole, a removed instruction keeps only its label */
+    int ic;            /* instruction address of the line */
+    int dc;            /* data address of the line */
+    syntax_ast ast;
+} parsed_line;
+
+/* a range of lines handled by one task */
+typedef struct {
+    int first, last;   /* lines [first, last) */
+    int cnt_ic;        /* instruction words of the chunk */
+    int cnt_dc;        /* data words of the chunk */
+    int base_ic;       /* instruction address of the chunk */
+    int base_dc;       /* data address of the chunk */
+    node_ptr extern_list;  /* extern references of the chunk, in address order */
+    diag_buffer diag;      /* diagnostics of the second iteration */
+    bool has_error;
+} chunk;
+
+/* a file being compiled */
+struct parallel_unit {
+    char *file_name;
+    char *amfile_name;
+    line_index index;
+    parsed_line *lines;
+    chunk *chunks;
+    int cnt_chunks;
+    int total_ic, total_dc;
+    int instruction[MAX_CODE];
+    int data_code[MAX_CODE];
+    node_ptr symbol_head;  /* read only during the second iteration */
+    node_ptr extern_list;
+    node_ptr entry_list;
+    bool has_error;
+    diag_buffer *diag;     /* NULL to keep the diagnostics destination of the thread */
+    diag_buffer *prev;     /* destination before the current step */
+};
+
+/*** functions prototypes ***/
+
+/* Splits the lines to chunks */
+static void split_chunks(parallel_unit *unit, int jobs);
+
+/* Loads the state of the unit into the thread, before a step */
+static void enter_unit(parallel_unit *unit);
+
+/* Keeps the state of the thread in the unit, after a step */
+static void leave_unit(parallel_unit *unit);
+
+/* Checks if an entry names an extern symbol, which changes the encoding of the lines after it */
+static bool entry_of_extern(parallel_unit *unit);
+
+/* Second iteration over the parsed lines, one at a time */
+static void second_iteration_serial(parallel_unit *unit);
+
+/* The --peephole pass over the parsed lines, before the addresses are given */
+static void peephole_unit(parallel_unit *unit);
+
+/* Checks if a jmp or bne at line i goes to the next instruction */
+static bool jumps_to_next(parallel_unit *unit, int i);
+
+
+/* compiles the am_file with the lines parsed on all cores */
+void compile_parallel(char *file_name) {
+    parallel_unit *unit;
+    int jobs = default_jobs();
+
+    unit = unit_create(file_name, jobs, NULL);
+
+    /* Parse all chunks at once */
+    parallel_for(unit->cnt_chunks, jobs, parse_chunk, unit);
+    unit_addresses(unit);
+    parallel_for(unit->cnt_chunks, jobs, place_chunk, unit);
+
+    if (unit_first_iteration(unit)) {
+        parallel_for(unit->cnt_chunks, jobs, encode_chunk, unit);
+        unit_merge_chunks(unit);
+    }
+    unit_write(unit);
+    unit_destroy(unit);
+}
+
+/* Loads the am_file and splits it to chunks for the given number of threads */
+parallel_unit *unit_create(char *file_name, int jobs, diag_buffer *diag) {
+    parallel_unit *unit = (parallel_unit *)asm_calloc(1, sizeof(parallel_unit));
+    valid_allocate(unit);
+
+    unit->file_name = file_name;
+    unit->amfile_name = output_name(file_name, MACRO_FILE);
+    if (!load_line_index(unit->amfile_name, &unit->index)) {
+        diag_printf("Error: couldn't open file");
+        asm_free(unit->amfile_name);
+        asm_free(unit);
+        fatal_error();
+    }
+    unit->diag = diag;
+    unit->lines = (parsed_line *)asm_malloc((unit->index.cnt_lines + 1) * sizeof(parsed_line));
+    valid_allocate(unit->lines);
+    split_chunks(unit, jobs);
+    return unit;
+}
+
+/* Number of chunks of the unit */
+int unit_chunks(parallel_unit *unit) {
+    return unit->cnt_chunks;
+}
+
+/* Splits the lines to chunks */
+static void split_chunks(parallel_unit *unit, int jobs) {
+    int size, i;
+
+    size = unit->index.cnt_lines / (jobs * CHUNKS_PER_JOB) + 1;
+    if (size < MIN_CHUNK_LINES)
+        size = MIN_CHUNK_LINES;
+    unit->cnt_chunks = (unit->index.cnt_lines + size - 1) / size;
+    unit->chunks = (chunk *)asm_calloc(unit->cnt_chunks + 1, sizeof(chunk));
+    valid_allocate(unit->chunks);
+
+    for (i = 0; i < unit->cnt_chunks; i++) {
+        unit->chunks[i].first = i * size;
+        unit->chunks[i].last = (i + 1) * size < unit->index.cnt_lines ? (i + 1) * size : unit->index.cnt_lines;
+    }
+}
+
+/* Loads the state of the unit into the thread, before a step */
+static void enter_unit(parallel_unit *unit) {
+    file_am_name = unit->amfile_name;
+    has_error = unit->has_error;
+    if (unit->diag != NULL)
+        unit->prev = diag_redirect(unit->diag);
+}
+
+/* Keeps the state of the thread in the unit, after a step */
+static void leave_unit(parallel_unit *unit) {
+    unit->has_error = has_error;
+    file_am_name = NULL;
+    if (unit->diag != NULL)
+        diag_redirect(unit->prev);
+}
+
+/* Chunk step: parses the lines of a chunk and counts its words */
+void parse_chunk(int index, void *arg) {
+    parallel_unit *unit = (parallel_unit *)arg;
+    chunk *ch = &unit->chunks[index];
+    parsed_line *line;
+    int i, code_words, data_words;
+    stats_state prev = stats_enter(unit->file_name, phase_first_iteration);
+
+    ch->cnt_ic = 0;
+    ch->cnt_dc = 0;
+    for (i = ch->first; i < ch->last; i++) {
+        line = &unit->lines[i];
+        /* skip long lines, comment and empty line*/
+        if (unit->index.lines[i].too_long || comment_empty_line(unit->index.lines[i].text)) {
+            line->parsed = FALSE;
+            continue;
+        }
+        line->parsed = TRUE;
+        line->peephole = peep_none;
+        line->ast = syntax_ast_parse(unit->index.lines[i].text);
+        line_words(&line->ast, &code_words, &data_words);
+        /* Addresses relative to the chunk */
+        line->ic = ch->cnt_ic;
+        line->dc = ch->cnt_dc;
+        ch->cnt_ic += code_words;
+        ch->cnt_dc += data_words;
+    }
+    stats_leave(prev);
+}
+
+/* Gives every chunk its address, a prefix sum of the chunk sizes */
+void unit_addresses(parallel_unit *unit) {
+    int i;
+
+    if (options.peephole)
+        peephole_unit(unit);
+    unit->total_ic = 0;
+    unit->total_dc = 0;
+    for (i = 0; i < unit->cnt_chunks; i++) {
+        unit->chunks[i].base_ic = unit->total_ic;
+        unit->chunks[i].base_dc = unit->total_dc;
+        unit->total_ic += unit->chunks[i].cnt_ic;
+        unit->total_dc += unit->chunks[i].cnt_dc;
+    }
+}
+
+/* Chunk step: moves the lines of a chunk to their final addresses and encodes their data */
+void place_chunk(int index, void *arg) {
+    parallel_unit *unit = (parallel_unit *)arg;
+    chunk *ch = &unit->chunks[index];
+    parsed_line *line;
+    int i;
+    stats_state prev = stats_enter(unit->file_name, phase_first_iteration);
+
+    for (i = ch->first; i < ch->last; i++) {
+        line = &unit->lines[i];
+        if (!line->parsed)
+            continue;
+        line->ic += ch->base_ic;
+        line->dc += ch->base_dc;
+        dc = line->dc;
+        encode_line_data(&line->ast, unit->data_code);
+    }
+    stats_leave(prev);
+}
+
+/* Adds the symbols in line order, returns 1 if the chunks can be encoded in parallel */
+int unit_first_iteration(parallel_unit *unit) {
+    int i;
+    bool in_parallel = FALSE;
+    stats_state prev = stats_enter(unit->file_name, phase_first_iteration);
+
+    enter_unit(unit);
+    /* The symbols are added in line order, so the diagnostics are printed as in serial mode */
+    for (i = 0; i < unit->index.cnt_lines; i++) {
+        cnt_line = unit->index.lines[i].line_number;
+        if (unit->index.lines[i].too_long) {
+            long_line_error();
+        } else if (unit->lines[i].parsed) {
+            ic = unit->lines[i].ic;
+            dc = unit->lines[i].dc;
+            add_line_symbols(&unit->lines[i].ast, &unit->symbol_head);
+        }
+    }
+    ic = unit->total_ic;
+    dc = unit->total_dc;
+    finish_first_iteration(&unit->symbol_head, unit->data_code);
+    unit->total_dc = dc;
+
+    /* Second iteration, the symbol table is complete */
+    stats_enter(unit->file_name, phase_second_iteration);
+    if (!has_error) {
+        if (entry_of_extern(unit))
+            second_iteration_serial(unit);
+        else
+            in_parallel = TRUE;
+    }
+    leave_unit(unit);
+    stats_leave(prev);
+    return in_parallel;
+}
+
+/* Checks if an entry names an extern symbol, which changes the encoding of the lines after it */
+static bool entry_of_extern(parallel_unit *unit) {
+    parsed_line *line;
+    symbol_node *found;
+    int i;
+
+    for (i = 0; i < unit->index.cnt_lines; i++) {
+        line = &unit->lines[i];
+        if (line->parsed && line->ast.opt_ast == direct && line->ast.dir_inst.direct.dir_opt == opt_entry) {
+            found = get_symbol(&unit->symbol_head, line->ast.dir_inst.direct.direct_params.symbol);
+            if (found != NULL && get_type(found) == external)
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* Chunk step: encodes the instructions of a chunk into its slice of the instruction segment */
+void encode_chunk(int index, void *arg) {
+    parallel_unit *unit = (parallel_unit *)arg;
+    chunk *ch = &unit->chunks[index];
+    parsed_line *line;
+    diag_buffer *prev;
+    bool saved_error = has_error;
+    char *saved_name = file_am_name;
+    int i;
+    stats_state prev_stats = stats_enter(unit->file_name, phase_second_iteration);
+
+    memset(&ch->diag, 0, sizeof(diag_buffer));
+    ch->extern_list = NULL;
+    prev = diag_redirect(&ch->diag);
+    file_am_name = unit->amfile_name;
+    has_error = FALSE;
+    /* Every chunk starts at the address found in the first iteration */
+    ic = ch->base_ic;
+
+    for (i = ch->first; i < ch->last; i++) {
+        line = &unit->lines[i];
+        if (line->parsed && line->peephole != peep_removed && line->ast.opt_ast == instruct) {
+            cnt_line = unit->index.lines[i].line_number;
+            encode_command(line->ast, unit->instruction);
+            encode_operands(line->ast, &unit->symbol_head, &ch->extern_list, unit->instruction);
+        }
+    }
+
+    ch->has_error = has_error;
+    has_error = saved_error;
+    file_am_name = saved_name;
+    diag_redirect(prev);
+    stats_leave(prev_stats);
+}
+
+/* Adds the entries and merges the extern references and diagnostics of the chunks */
+void unit_merge_chunks(parallel_unit *unit) {
+    parsed_line *line;
+    diag_buffer *bufs, *prev;
+    int i;
+    stats_state prev_stats = stats_enter(unit->file_name, phase_second_iteration);
+
+    enter_unit(unit);
+    /* The entries change the symbol table, they are added in line order */
+    bufs = (diag_buffer *)asm_calloc(unit->cnt_chunks + 1, sizeof(diag_buffer));
+    valid_allocate(bufs);
+    prev = diag_redirect(&bufs[unit->cnt_chunks]);
+    for (i = 0; i < unit->index.cnt_lines; i++) {
+        line = &unit->lines[i];
+        if (line->parsed && line->ast.opt_ast == direct && line->ast.dir_inst.direct.dir_opt == opt_entry) {
+            cnt_line = unit->index.lines[i].line_number;
+            add_entry(line->ast.dir_inst.direct.direct_params.symbol, &unit->symbol_head, &unit->entry_list);
+        }
+    }
+    diag_redirect(prev);
+
+    /* Merge the chunks in address order */
+    for (i = 0; i < unit->cnt_chunks; i++) {
+        append_list(&unit->extern_list, &unit->chunks[i].extern_list);
+        if (unit->chunks[i].has_error)
+            has_error = TRUE;
+        bufs[i] = unit->chunks[i].diag;
+        memset(&unit->chunks[i].diag, 0, sizeof(diag_buffer));
+    }
+    diag_merge(bufs, unit->cnt_chunks + 1);
+    for (i = 0; i <= unit->cnt_chunks; i++)
+        diag_clear(&bufs[i]);
+    asm_free(bufs);
+    leave_unit(unit);
+    stats_leave(prev_stats);
+}
+
+/* Second iteration over the parsed lines, one at a time */
+static void second_iteration_serial(parallel_unit *unit) {
+    int i;
+
+    ic = 0;
+    for (i = 0; i < unit->index.cnt_lines; i++) {
+        if (unit->lines[i].parsed && unit->lines[i].peephole != peep_removed) {
+            cnt_line = unit->index.lines[i].line_number;
+            second_iteration_line(&unit->lines[i].ast, &unit->symbol_head, &unit->extern_list, &unit->entry_list, unit->instruction);
+        }
+    }
+}
+
+/* The --peephole pass over the parsed lines. The instructions are removed or shortened by themselves
+ * first, then the jumps to the next instruction are removed from the last one up, so a jump followed
+ * by removed jumps to the same place goes too. At last every chunk counts its words again.
+ * A file with a syntax error isn't changed, its errors are reported as they are */
+static void peephole_unit(parallel_unit *unit) {
+    parsed_line *line;
+    int i, j, code_words, data_words, cnt_removed = 0, cnt_shortened = 0, words = 0;
+
+    for (i = 0; i < unit->index.cnt_lines; i++)
+        if (unit->lines[i].parsed && *unit->lines[i].ast.syntax_error != '\0')
+            return;
+    enter_unit(unit);
+    for (i = 0; i < unit->index.cnt_lines; i++)
+        if (unit->lines[i].parsed)
+            unit->lines[i].peephole = peephole_line(&unit->lines[i].ast);
+    for (i = unit->index.cnt_lines - 1; i >= 0; i--)
+        if (unit->lines[i].parsed && unit->lines[i].peephole == peep_none && jumps_to_next(unit, i))
+            unit->lines[i].peephole = peep_removed;
+    for (i = 0; i < unit->index.cnt_lines; i++) {
+        line = &unit->lines[i];
+        if (!line->parsed || line->peephole == peep_none)
+            continue;
+        cnt_removed += line->peephole == peep_removed;
+        cnt_shortened += line->peephole == peep_shortened;
+        peephole_report(unit->amfile_name, unit->index.lines[i].line_number, unit->index.lines[i].text, line->peephole, &line->ast);
+    }
+
+    /* The addresses in the chunks follow the new sizes */
+    for (i = 0; i < unit->cnt_chunks; i++) {
+        words += unit->chunks[i].cnt_ic;
+        unit->chunks[i].cnt_ic = 0;
+        for (j = unit->chunks[i].first; j < unit->chunks[i].last; j++) {
+            line = &unit->lines[j];
+            if (!line->parsed)
+                continue;
+            line->ic = unit->chunks[i].cnt_ic;
+            if (line->peephole != peep_removed) {
+                line_words(&line->ast, &code_words, &data_words);
+                unit->chunks[i].cnt_ic += code_words;
+            }
+        }
+        words -= unit->chunks[i].cnt_ic;
+    }
+    diag_printf("\n Peephole in %s: %d instructions removed, %d shortened, %d words saved \n", unit->amfile_name,
+                cnt_removed, cnt_shortened, words);
+    leave_unit(unit);
+}
+
+/* Checks if a jmp or bne at line i goes to the next instruction. The directives and the removed
+ * instructions between them take no code words, so a label on any of those instructions is at the
+ * address of the next instruction too */
+static bool jumps_to_next(parallel_unit *unit, int i) {
+    syntax_ast *jump = &unit->lines[i].ast;
+    parsed_line *line;
+    int j;
+
+    if (jump->opt_ast != instruct || jump->dir_inst.instruct.op_met[1] != label_op)
+        return FALSE;
+    for (j = i + 1; j < unit->index.cnt_lines; j++) {
+        line = &unit->lines[j];
+        if (!line->parsed || line->ast.opt_ast != instruct)
+            continue;
+        if (*line->ast.label_name != '\0' && peephole_jumps_to(jump, line->ast.label_name))
+            return TRUE;
+        if (line->peephole != peep_removed)
+            return FALSE;
+    }
+    return FALSE;
+}
+
+/* Creates the output files if no errors were found */
+void unit_write(parallel_unit *unit) {
+    enter_unit(unit);
+    /* the .ob file starts with ic and dc */
+    ic = unit->total_ic;
+    dc = unit->total_dc;
+    create_output_files(unit->file_name, unit->instruction, unit->data_code, &unit->entry_list, &unit->extern_list);
+    leave_unit(unit);
+}
+
+/* Frees the unit */
+void unit_destroy(parallel_unit *unit) {
+    int i;
+
+    for (i = 0; i < unit->cnt_chunks; i++) {
+        clear_list(&unit->chunks[i].extern_list);
+        diag_clear(&unit->chunks[i].diag);
+    }
+    asm_free(unit->lines);
+    asm_free(unit->chunks);
+    clear_line_index(&unit->index);
+    asm_free(unit->amfile_name);
+    clear_list(&unit->extern_list);
+    clear_list(&unit->entry_list);
+    clear_list(&unit->symbol_head);
+    asm_free(unit);
+}
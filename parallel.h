@@ -0,0 +1,51 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include "diag.h"
+
+/* Data-parallel mode: the lines of the am_file are split to chunks which are
+ * parsed on all cores. Every chunk counts its own instruction and data words,
+ * and a prefix sum over the chunks gives every line its final address. Once
+ * the symbol table is complete the chunks are encoded at once.
+ *
+ * The steps of a unit (one file) may run on any thread, one step at a time,
+ * while the chunk steps of the same stage may run together. */
+
+typedef struct parallel_unit parallel_unit;
+
+/* compiles the am_file with the lines parsed on all cores */
+void compile_parallel(char *file_name);
+
+/* Loads the am_file and splits it to chunks for the given number of threads,
+ * diagnostics go to diag, or to the current destination if diag is NULL */
+parallel_unit *unit_create(char *file_name, int jobs, diag_buffer *diag);
+
+/* Number of chunks of the unit */
+int unit_chunks(parallel_unit *unit);
+
+/* Chunk step: parses the lines of a chunk and counts its words */
+void parse_chunk(int index, void *unit);
+
+/* Gives every chunk its address, a prefix sum of the chunk sizes */
+void unit_addresses(parallel_unit *unit);
+
+/* Chunk step: moves the lines of a chunk to their final addresses and encodes their data */
+void place_chunk(int index, void *unit);
+
+/* Adds the symbols in line order, returns 1 if the chunks can be encoded in parallel.
+ * When they can't, the second iteration (if any) is done here */
+int unit_first_iteration(parallel_unit *unit);
+
+/* Chunk step: encodes the instructions of a chunk into its slice of the instruction segment */
+void encode_chunk(int index, void *unit);
+
+/* Adds the entries and merges the extern references and diagnostics of the chunks */
+void unit_merge_chunks(parallel_unit *unit);
+
+/* Creates the output files if no errors were found */
+void unit_write(parallel_unit *unit);
+
+/* Frees the unit */
+void unit_destroy(parallel_unit *unit);
+
+#endif
@@ -0,0 +1,77 @@
+/*** peephole.c removes and shortens single instructions for --peephole ***/
+#include <stdio.h>
+#include <string.h>
+#include "peephole.h"
+#include "diag.h"
+
+/*** functions prototypes ***/
+
+/* Rewrites a two operand instruction with an immediate source to a one operand instruction on the dest */
+static void to_one_operand(instruct_ast *inst, enum instruct_opt opt);
+
+
+/* Removes or shortens one instruction by itself */
+peep_change peephole_line(syntax_ast *ast) {
+    instruct_ast *inst = &ast->dir_inst.instruct;
+
+    if (ast->opt_ast != instruct || *ast->syntax_error != '\0')
+        return peep_none;
+    switch (inst->inst_opt) {
+        case instruct_mov:
+            if (inst->op_met[0] == reg_num_op && inst->op_met[1] == reg_num_op &&
+                inst->op_opt[0].reg_num == inst->op_opt[1].reg_num)
+                return peep_removed;
+            if (inst->op_met[0] == num_op && inst->op_opt[0].num == 0) {
+                to_one_operand(inst, instruct_clr);
+                return peep_shortened;
+            }
+            break;
+        case instruct_add:
+        case instruct_sub:
+            if (inst->op_met[0] != num_op)
+                break;
+            if (inst->op_opt[0].num == 0)
+                return peep_removed;
+            /* sub 1 adds -1 */
+            if (inst->op_opt[0].num == 1 || inst->op_opt[0].num == -1) {
+                to_one_operand(inst, (inst->op_opt[0].num == 1) == (inst->inst_opt == instruct_add) ? instruct_inc : instruct_dec);
+                return peep_shortened;
+            }
+            break;
+        default:
+            break;
+    }
+    return peep_none;
+}
+
+/* Returns 1 if the instruction is a jmp or a bne to the label */
+int peephole_jumps_to(syntax_ast *ast, char *label) {
+    instruct_ast *inst = &ast->dir_inst.instruct;
+
+    return ast->opt_ast == instruct && *ast->syntax_error == '\0' &&
+           (inst->inst_opt == instruct_jmp || inst->inst_opt == instruct_bne) &&
+           inst->op_met[1] == label_op && strcmp(inst->op_opt[1].symbol, label) == 0;
+}
+
+/* Prints the change of a line, the text is the source line */
+void peephole_report(char *file_name, int line_number, char *text, peep_change change, syntax_ast *ast) {
+    static const char *names[] = {"mov", "cmp", "add", "sub", "not", "clr", "lea", "inc",
+                                  "dec", "jmp", "bne", "red", "prn", "jsr", "rts", "stop"};
+    int len;
+
+    while (*text == ' ' || *text == '\t')
+        text++;
+    for (len = strlen(text); len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'); len--)
+        ;
+    if (change == peep_removed)
+        diag_printf("\n Peephole in %s, line %d: removed '%.*s' \n", file_name, line_number, len, text);
+    else
+        diag_printf("\n Peephole in %s, line %d: shortened '%.*s' to %s \n", file_name, line_number, len, text,
+                    names[ast->dir_inst.instruct.inst_opt]);
+}
+
+/* Rewrites a two operand instruction with an immediate source to a one operand instruction on the dest */
+static void to_one_operand(instruct_ast *inst, enum instruct_opt opt) {
+    inst->inst_opt = opt;
+    inst->op_met[0] = zero_op;
+}
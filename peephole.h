@@ -0,0 +1,35 @@
+#ifndef _PEEPHOLE_H_
+#define _PEEPHOLE_H_
+
+#include "syntax.h"
+
+/* The peephole pass of --peephole: it runs over the parsed lines of a file before the addresses
+ * are given, removes the instructions which do nothing and shortens the ones which have a shorter
+ * form with the same result. The removed instructions take no words, so their labels point to the
+ * next instruction. The flags which a removed or shortened add, sub or mov would set are not kept,
+ * a program which tests them after such an instruction must not use the option. */
+
+/* the change the pass made to an instruction */
+typedef enum {
+    peep_none,
+    peep_removed,
+    peep_shortened
+} peep_change;
+
+/* Removes or shortens one instruction by itself:
+ *   mov @rX, @rX            removed
+ *   add 0, X / sub 0, X     removed
+ *   add 1, X / sub -1, X    shortened to inc X
+ *   sub 1, X / add -1, X    shortened to dec X
+ *   mov 0, X                shortened to clr X
+ * A shortened instruction is rewritten in the ast, a removed one is left as it is */
+peep_change peephole_line(syntax_ast *ast);
+
+/* Returns 1 if the instruction is a jmp or a bne to the label, which does nothing
+ * when the label is on the next instruction */
+int peephole_jumps_to(syntax_ast *ast, char *label);
+
+/* Prints the change of a line, the text is the source line */
+void peephole_report(char *file_name, int line_number, char *text, peep_change change, syntax_ast *ast);
+
+#endif
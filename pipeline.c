@@ -0,0 +1,233 @@
+/*** pipeline.c runs the pre processor, the parser and the encoder of one file as a pipeline ***/
+#include <pthread.h>
+#include "compile.h"
+#include "pre_processor.h"
+#include "ring_buffer.h"
+#include "push_parser.h"
+#include "stats.h"
+#include "pipeline.h"
+
+#define TEXT_CHUNK 4096    /* bytes of am text in one chunk */
+#define TEXT_SLOTS 16      /* chunks between the expander and the parser */
+#define LINE_SLOTS 256     /* records between the parser and the encoder */
+
+/* a piece of the am_file, from the expander to the parser */
+typedef struct {
+    int size;              /* bytes used in text */
+    bool last;             /* no more text after this chunk */
+    bool failed;           /* the macros were invalid, there is no am text */
+    char text[TEXT_CHUNK];
+} text_chunk;
+
+/* a line of the am_file, from the parser to the encoder */
+typedef struct {
+    enum {
+        rec_line,          /* ast holds the parsed line */
+        rec_long,          /* the line is longer than the allowed length */
+        rec_end,           /* end of file */
+        rec_failed         /* end of file, the macros were invalid */
+    } kind;
+    int line;              /* line number in the am_file */
+    syntax_ast ast;        /* a span of the ast points to a copy of its text, freed by the encoder */
+} line_record;
+
+/* state shared by the stages of one file */
+typedef struct {
+    char *file_name;
+    ring_buffer *text_ring;  /* expander -> parser */
+    ring_buffer *line_ring;  /* parser -> encoder */
+    text_chunk *chunk;       /* chunk being filled by the expander */
+    diag_buffer expand_diag; /* diagnostics of the expander, printed before the ones of the encoder */
+} pipeline;
+
+/*** functions prototypes ***/
+
+/* Stage 1: expands the macros and sends the am text to the parser */
+static void *expand_stage(void *arg);
+
+/* Receives the am text from the pre processor and fills the text chunks */
+static void push_text(char *text, void *arg);
+
+/* Stage 2: splits the am text to lines like fgets does and parses them */
+static void *parse_stage(void *arg);
+
+/* Sends a parsed line to the encoder */
+static void send_line(syntax_ast *ast, int line_number, void *arg);
+
+/* Stage 3: compiles the lines as they are parsed and writes the outputs, returns 0 if the macros were invalid */
+static int encode_stage(pipeline *pl);
+
+
+/* compiles the as_file in pipelined mode, returns 0 if the macros were invalid */
+int compile_pipelined(char *file_name) {
+    pipeline pl;
+    pthread_t expander, parser;
+    diag_buffer encode_diag = {0}, *prev;
+    int result;
+
+    pl.file_name = file_name;
+    pl.text_ring = ring_create(sizeof(text_chunk), TEXT_SLOTS);
+    pl.line_ring = ring_create(sizeof(line_record), LINE_SLOTS);
+    pl.chunk = NULL;
+    memset(&pl.expand_diag, 0, sizeof(diag_buffer));
+
+    if (pthread_create(&expander, NULL, expand_stage, &pl) != 0 ||
+        pthread_create(&parser, NULL, parse_stage, &pl) != 0) {
+        printf("Error: couldn't create the pipeline threads\n");
+        exit(1);
+    }
+
+    /* The encoder runs on the calling thread, it owns the global counters */
+    prev = diag_redirect(&encode_diag);
+    result = encode_stage(&pl);
+
+    pthread_join(expander, NULL);
+    pthread_join(parser, NULL);
+
+    /* The diagnostics go where the ones of the caller go, in the order of the serial mode: the macros first */
+    diag_redirect(prev);
+    diag_flush(&pl.expand_diag);
+    diag_flush(&encode_diag);
+    ring_destroy(pl.text_ring);
+    ring_destroy(pl.line_ring);
+    return result;
+}
+
+/* Stage 1: expands the macros and sends the am text to the parser */
+static void *expand_stage(void *arg) {
+    pipeline *pl = (pipeline *)arg;
+    bool ok;
+
+    diag_redirect(&pl->expand_diag);
+    ok = pre_processor_stream(pl->file_name, push_text, pl);
+
+    /* Close the stream, the last chunk may still hold text */
+    if (pl->chunk == NULL) {
+        pl->chunk = (text_chunk *)ring_reserve(pl->text_ring);
+        pl->chunk->size = 0;
+    }
+    pl->chunk->last = TRUE;
+    pl->chunk->failed = !ok;
+    ring_commit(pl->text_ring);
+    return NULL;
+}
+
+/* Receives the am text from the pre processor and fills the text chunks */
+static void push_text(char *text, void *arg) {
+    pipeline *pl = (pipeline *)arg;
+    int len = strlen(text), n;
+
+    while (len > 0) {
+        if (pl->chunk == NULL) {
+            pl->chunk = (text_chunk *)ring_reserve(pl->text_ring);
+            pl->chunk->size = 0;
+            pl->chunk->last = FALSE;
+            pl->chunk->failed = FALSE;
+        }
+        n = TEXT_CHUNK - pl->chunk->size;
+        if (n > len)
+            n = len;
+        memcpy(pl->chunk->text + pl->chunk->size, text, n);
+        pl->chunk->size += n;
+        text += n;
+        len -= n;
+        /* Publish full chunks */
+        if (pl->chunk->size == TEXT_CHUNK) {
+            ring_commit(pl->text_ring);
+            pl->chunk = NULL;
+        }
+    }
+}
+
+/* Stage 2: splits the am text to lines like fgets does and parses them */
+static void *parse_stage(void *arg) {
+    pipeline *pl = (pipeline *)arg;
+    push_parser parser;
+    bool last, failed;
+    text_chunk *chunk;
+    line_record *rec;
+    stats_state prev = stats_enter(pl->file_name, phase_first_iteration);
+
+    parser_init(&parser, send_line, pl);
+    do {
+        chunk = (text_chunk *)ring_front(pl->text_ring);
+        parser_feed(&parser, chunk->text, chunk->size);
+        last = chunk->last;
+        failed = chunk->failed;
+        ring_release(pl->text_ring);
+    } while (!last);
+    parser_finish(&parser);
+
+    rec = (line_record *)ring_reserve(pl->line_ring);
+    rec->kind = failed ? rec_failed : rec_end;
+    ring_commit(pl->line_ring);
+    stats_leave(prev);
+    return NULL;
+}
+
+/* Sends a parsed line to the encoder */
+static void send_line(syntax_ast *ast, int line_number, void *arg) {
+    pipeline *pl = (pipeline *)arg;
+    line_record *rec;
+    text_span *span;
+    char *text;
+
+    rec = (line_record *)ring_reserve(pl->line_ring);
+    if (ast == NULL) {
+        rec->kind = rec_long;
+    } else {
+        rec->kind = rec_line;
+        rec->ast = *ast;
+        /* The splitter reuses the line before the encoder reads the span, the encoder gets its own copy */
+        if ((span = operand_span(&rec->ast)) != NULL) {
+            text = (char *)asm_malloc(span->len + 1);
+            valid_allocate(text);
+            memcpy(text, span->line + span->start, span->len);
+            text[span->len] = '\0';
+            span->line = text;
+            span->start = 0;
+        }
+    }
+    rec->line = line_number;
+    ring_commit(pl->line_ring);
+}
+
+/* Stage 3: compiles the lines as they are parsed and writes the outputs, returns 0 if the macros were invalid */
+static int encode_stage(pipeline *pl) {
+    push_context *ctx = push_begin(pl->file_name);
+    line_record *rec;
+    bool done = FALSE, failed = FALSE;
+    stats_state prev = stats_enter(pl->file_name, phase_first_iteration);
+
+    /* First iteration, the lines are handled as soon as they are parsed */
+    while (!done) {
+        rec = (line_record *)ring_front(pl->line_ring);
+        switch (rec->kind) {
+            case rec_line:
+                push_line(ctx, &rec->ast, rec->line);
+                if (operand_span(&rec->ast) != NULL)
+                    asm_free(rec->ast.dir_inst.direct.span.line);
+                break;
+            case rec_long:
+                push_line(ctx, NULL, rec->line);
+                break;
+            case rec_failed:
+                failed = TRUE;
+                done = TRUE;
+                break;
+            case rec_end:
+                done = TRUE;
+                break;
+        }
+        ring_release(pl->line_ring);
+    }
+
+    stats_leave(prev);
+
+    /* The second iteration and the outputs */
+    if (failed)
+        push_abort(ctx);
+    else
+        push_finish(ctx);
+    return !failed;
+}
@@ -0,0 +1,10 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+/* Pipelined mode: the macro expander, the line parser and the encoder run on
+ * separate threads, connected by ring buffers of text chunks and line records */
+
+/* compiles the as_file in pipelined mode, returns 0 if the macros were invalid */
+int compile_pipelined(char *file_name);
+
+#endif
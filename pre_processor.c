@@ -4,13 +4,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "pre_processor.h"
+#include "diag.h"
+#include "cache.h"
+#include "stream.h"
+#include "line_index.h"
+#include "stats.h"
+#include "probes.h"
 
 /** Macro struct **/
-typedef struct Macros {
+struct Macros {
     char macro_name[MAX_LINE_LENGTH]; /* The title of the macro */
     char *macro_sentence; /* The sentences of the macro */
     struct Macros* next; /* Next macro on the list */
-} Macro;
+};
 
 
 /*** functions prototypes ***/
@@ -27,9 +33,6 @@ int is_macro_exist(char* nameOfMacro, Macro* head);
 /* Check if the provided line contains either "macro" or "endmacro" */
 int macro_validation(char line[]);
 
-/* Insert macros from the specified file into the linked list */
-int insert_macro(char* file_name, Macro** head);
-
 /* Insert the name of a macro into the macro list */
 int insert_macro_name(Macro* temp, char line[]);
 
@@ -39,37 +42,42 @@ void insert_macro_sentence(Macro* temp, FILE* fpR);
 /* Add a new node containing a macro to the macro list */
 void add_macro_node(Macro* temp, Macro** head);
 
-/* Search for a macro in the line and write its sentences to a file */
-int find_macro(char line[], FILE* fpW, Macro** head);
+/* Write text to the am_file and pass it to the sink */
+void write_am(am_output *out, char *text);
 
 /* Replace macro names with their sentences and write to a new file */
-void macro_open(char* file_name, Macro** head);
-
-/* Clear the macro list and free associated memory */
-void clear_macro_list(Macro** list);
+void macro_open(char* file_name, Macro** head, am_sink sink, void *arg);
 
 
 /*pre_pricess the as_file and creayes the am_file*/
 int pre_processor(char *file_name ){	
+	return pre_processor_stream(file_name, NULL, NULL);
+}
+
+/*pre_process the as_file, creates the am_file and passes its text to the sink*/
+int pre_processor_stream(char *file_name, am_sink sink, void *arg){
 	int f;
 	Macro *head = NULL;
+	stats_state prev = stats_enter(file_name, phase_pre_processor);
 
 	f = insert_macro(file_name,&head);
 	if(!f)
 	{	
-		macro_open(file_name, &head);
+		macro_open(file_name, &head, sink, arg);
 		clear_macro_list(&head);
+		stats_leave(prev);
 		return 1;
 	}
 	else
 	    clear_macro_list(&head);
+		stats_leave(prev);
 		return 0;
 
 }
 
 /* Create a node for the macro */ 
 Macro *create_node() {
-    Macro *newNode = (Macro *)malloc(sizeof(Macro)); /* Allocate memory for the new node using malloc*/
+    Macro *newNode = (Macro *)asm_malloc(sizeof(Macro)); /* Allocate memory for the new node using malloc*/
     if (newNode == NULL) {
         printf("Error: Unable to allocate memory.\n");
         exit(1);
@@ -122,9 +130,11 @@ int macro_validation(char line[])
     while (isspace(line[lineIndex]))
         lineIndex++;
 
-    /* Extract the first word from the line */
-    while (!isspace(line[lineIndex]) && line[lineIndex] != '\n')
+    /* Extract the first word from the line, a longer word than the buffer isn't a keyword */
+    while (!isspace(line[lineIndex]) && line[lineIndex] != '\n' && line[lineIndex] != '\0')
     {
+        if (macroIndex == MAX_LINE_LENGTH - 1)
+            return 0;
         macro[macroIndex] = line[lineIndex];
         macroIndex++;
         lineIndex++;
@@ -144,22 +154,23 @@ int macro_validation(char line[])
 /* Insert all macros into the list */
 int insert_macro(char* file_name, Macro** head)
 {
-    char line[MAX_LINE_LENGTH];
+    char *line = NULL;
+    int size;
     char* input_fname;
     FILE* fpR;
     input_fname = name_file(file_name, INPUT_FILE); /* Get input file name */
-    memset(line, '\0', MAX_LINE_LENGTH);
 
-    fpR = fopen(input_fname, "r");
+    fpR = open_input(input_fname);
     if (fpR == NULL)
     {
-        printf("Error: Can't open file: %s\n", input_fname);
+        diag_printf("Error: Can't open file: %s\n", input_fname);
+        asm_free(input_fname);
         return 1; /* Return error if unable to open input file */
     }
 
-    while (fgets(line, MAX_LINE_LENGTH, fpR))
+    while (read_line(fpR, &line, &size))
     {
-        if (strlen(line) == MAX_LINE_LENGTH - 1 && line[MAX_LINE_LENGTH - 2] != '\n')
+        if (line_too_long(line))
         {
             /* Read and discard remaining characters of the long line */
             int ch;
@@ -174,7 +185,11 @@ int insert_macro(char* file_name, Macro** head)
             {
                 if (is_macro_exist(temp->macro_name, *head)) /* Check if macro name already exists */
                 {
-                    printf("Error: Macro name - %s already exists.\n", temp->macro_name);
+                    diag_printf("Error: Macro name - %s already exists.\n", temp->macro_name);
+                    asm_free(temp);
+                    asm_free(input_fname);
+                    asm_free(line);
+                    fclose(fpR);
                     return 1; /* Return error if macro name already exists */
                 }
                 insert_macro_sentence(temp, fpR); /* Insert macro sentences into the node */
@@ -182,11 +197,15 @@ int insert_macro(char* file_name, Macro** head)
             }
             else
             {
+                asm_free(input_fname);
+                asm_free(line);
+                fclose(fpR);
                 return 1; /* Return error if unable to insert macro name */
             }
         }
     }
-    free(input_fname); /* Free allocated memory for input file name */
+    asm_free(input_fname); /* Free allocated memory for input file name */
+    asm_free(line);
     fclose(fpR); /* Close input file */
     return 0; /* Return success */
 }
@@ -214,9 +233,15 @@ int insert_macro_name(Macro* temp, char line[])
     while (isspace(line[lineIndex]))
         lineIndex++;
 
-    /* Extract the macro name */
-    while (!isspace(line[lineIndex]) && line[lineIndex] != '\n')
+    /* Extract the macro name, a name which doesn't fit in the node is invalid */
+    while (!isspace(line[lineIndex]) && line[lineIndex] != '\n' && line[lineIndex] != '\0')
     {
+        if (macroIndex == MAX_LINE_LENGTH - 1)
+        {
+            diag_printf("Error: The macro name is longer than %d chars.\n", MAX_LINE_LENGTH - 1);
+            asm_free(temp);
+            return 0;
+        }
         macro[macroIndex] = line[lineIndex];
         macroIndex++;
         lineIndex++;
@@ -227,8 +252,8 @@ int insert_macro_name(Macro* temp, char line[])
         strcpy(temp->macro_name, macro); /* Copy the valid macro name */
     else
     {
-        printf("Error: The macro name %s is a reserved keyword.\n", temp->macro_name);
-        free(temp); /* Free the allocated memory for the node */
+        diag_printf("Error: The macro name %s is a reserved keyword.\n", temp->macro_name);
+        asm_free(temp); /* Free the allocated memory for the node */
         return 0;
     }
 
@@ -238,16 +263,18 @@ int insert_macro_name(Macro* temp, char line[])
 /* Insert the sentences of the macro into the list */
 void insert_macro_sentence(Macro *temp, FILE *fpR) {
   
-    char line[MAX_LINE_LENGTH];
+    char *line = NULL;
+    int size;
     char *sentence = NULL, *new_sentence = NULL;/* Declare a pointer for the sentence */
     unsigned int  sentence_length = 0; /* To keep track of the sentence length */
 	unsigned int new_length = 0;
 	
 
-    memset(line, '\0', MAX_LINE_LENGTH);
-    fgets(line, MAX_LINE_LENGTH, fpR);
+    if (!read_line(fpR, &line, &size)) {
+        *line = '\0';
+    }
 
-	sentence = (char *)calloc(MAX_LINE_LENGTH, sizeof(char)); /* Allocate memory for macro_sentence*/
+	sentence = (char *)asm_calloc(MAX_LINE_LENGTH, sizeof(char)); /* Allocate memory for macro_sentence*/
     if (sentence == NULL) {
         printf("Error: Unable to allocate memory for macro_sentence.\n");
         exit(1);
@@ -258,7 +285,7 @@ void insert_macro_sentence(Macro *temp, FILE *fpR) {
         new_length = sentence_length + strlen(line);
 
         /* Allocate memory for the new sentence using realloc */
-        new_sentence = (char *)realloc(sentence, new_length + 1);
+        new_sentence = (char *)asm_realloc(sentence, new_length + 1);
         if (new_sentence == NULL) {
             /* Handle allocation failure */
             printf("Error: Unable to allocate memory for sentence.\n");
@@ -271,8 +298,9 @@ void insert_macro_sentence(Macro *temp, FILE *fpR) {
         sentence = new_sentence; /* Update the sentence pointer */
         sentence_length = new_length; /* Update the sentence length */
 
-        fgets(line, MAX_LINE_LENGTH, fpR);
+        read_line(fpR, &line, &size);
     }
+    asm_free(line);
 
     /* Null-terminate the sentence */
     sentence[sentence_length] = '\0';
@@ -305,7 +333,7 @@ void add_macro_node(Macro* temp, Macro** head)
 }
 
  /* Search if there is a macro in the line */
-int find_macro(char line[], FILE* fpW, Macro** head)
+int find_macro(char line[], am_output *out, Macro** head)
 {
     int lineIndex = 0, macroIndex = 0;
     Macro* temp;
@@ -317,9 +345,11 @@ int find_macro(char line[], FILE* fpW, Macro** head)
     while (isspace(line[lineIndex]))
         lineIndex++;
 
-    /* Extract macro name from the line */
-    while (!isspace(line[lineIndex]) && line[lineIndex] != '\n')
+    /* Extract macro name from the line, a longer word than the buffer isn't a macro name */
+    while (!isspace(line[lineIndex]) && line[lineIndex] != '\n' && line[lineIndex] != '\0')
     {
+        if (macroIndex == MAX_LINE_LENGTH - 1)
+            return 0;
         macro[macroIndex] = line[lineIndex];
         macroIndex++;
         lineIndex++;
@@ -330,7 +360,9 @@ int find_macro(char line[], FILE* fpW, Macro** head)
     {
         if (strcmp(temp->macro_name, macro) == 0)
         {
-            fprintf(fpW, "%s", temp->macro_sentence); /* Write macro sentences to the output file */
+            write_am(out, temp->macro_sentence); /* Write macro sentences to the output file */
+            stats_count(stat_macro_expansions, 1);
+            probe1(macro_expand, temp->macro_name);
             return 1; /* Macro found and written */
         }
         temp = temp->next; /* Move to the next macro in the list */
@@ -339,37 +371,60 @@ int find_macro(char line[], FILE* fpW, Macro** head)
     return 0; /* No matching macro found in the line */
 }
 
+/* Write text to the am_file and pass it to the sink */
+void write_am(am_output *out, char *text)
+{
+    fprintf(out->fp, "%s", text);
+    if (out->sink != NULL)
+        out->sink(text, out->arg);
+}
+
 /* Write to a new file the text and replace the macro name with the sentences */
-void macro_open(char *file_name, Macro** head)
+void macro_open(char *file_name, Macro** head, am_sink sink, void *arg)
 {
     int macroFlag = 0; /* Flag to track if inside a macro definition */
     FILE* fpR;
     FILE* fpW;
-    char line[MAX_LINE_LENGTH];
+    am_output out;
+    char *line = NULL;
+    int size;
     char *input_fname;
     char *output_fname;
-    memset(line, '\0', MAX_LINE_LENGTH);
 
     input_fname = name_file(file_name, INPUT_FILE);
-    output_fname = name_file(file_name, MACRO_FILE);
+    output_fname = output_name(file_name, MACRO_FILE);
 
-    fpR = fopen(input_fname, "r");
-    fpW = fopen(output_fname, "w");
+    fpR = open_input(input_fname);
     if (fpR == NULL)
     {
-        printf("Error: Can't open file: %s\n", input_fname);
+        diag_printf("Error: Can't open file: %s\n", input_fname);
+        asm_free(input_fname);
+        asm_free(output_fname);
         return;
     }
+    fpW = open_output(output_fname);
+    if (fpW == NULL)
+    {
+        diag_printf("Error: Can't create file: %s\n", output_fname);
+        asm_free(input_fname);
+        asm_free(output_fname);
+        fclose(fpR);
+        fatal_error();
+    }
+    out.fp = fpW;
+    out.sink = sink;
+    out.arg = arg;
 
-    while (fgets(line, MAX_LINE_LENGTH, fpR))
+    while (read_line(fpR, &line, &size))
     {
+        stats_count(stat_lines, 1);
         if (!macroFlag)
         {
-            if (!find_macro(line, fpW, head)) /* Check if the line contains a macro call */
+            if (!find_macro(line, &out, head)) /* Check if the line contains a macro call */
             {
                 if (macro_validation(line) == 0) /* If not a macro call, write the line as is */
                 {
-                    fprintf(fpW, "%s", line);
+                    write_am(&out, line);
                 }
                 else
                 {
@@ -384,10 +439,11 @@ void macro_open(char *file_name, Macro** head)
         }
     }
 
-    free(input_fname);
-    free(output_fname);
     fclose(fpR);
-    fclose(fpW);
+    close_output(fpW, output_fname);
+    asm_free(line);
+    asm_free(input_fname);
+    asm_free(output_fname);
 }
 
 
@@ -401,10 +457,10 @@ void clear_macro_list(Macro **list) {
         nextNode = curr->next;
 
         /* Free the dynamically allocated macro_sentence */
-        free(curr->macro_sentence);
+        asm_free(curr->macro_sentence);
 
         /* Free the curr node */
-        free(curr);
+        asm_free(curr);
 
         /* Move to the next node */
         curr = nextNode;
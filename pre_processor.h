@@ -1,8 +1,34 @@
 #ifndef _PRE_PROCESSOR_H
 #define _PRE_PROCESSOR_H
+#include <stdio.h>
 #include "define.h"
 
+/* receives every piece of text which is written to the am_file */
+typedef void (*am_sink)(char *text, void *arg);
+
+/* destination of the expanded text */
+typedef struct {
+    FILE *fp;      /* the am_file */
+    am_sink sink;  /* optional listener for the written text */
+    void *arg;     /* argument for the sink */
+} am_output;
+
+/* a list of macros, defined in pre_processor.c */
+typedef struct Macros Macro;
+
 /*pre_process the as_file and creayes the am_file*/
 int pre_processor(char*);
 
+/*pre_process the as_file, creates the am_file and passes its text to the sink*/
+int pre_processor_stream(char *file_name, am_sink sink, void *arg);
+
+/* Insert macros from the specified file into the linked list */
+int insert_macro(char* file_name, Macro** head);
+
+/* Search for a macro in the line and write its sentences to a file */
+int find_macro(char line[], am_output *out, Macro** head);
+
+/* Clear the macro list and free associated memory */
+void clear_macro_list(Macro** list);
+
 #endif
\ No newline at end of file
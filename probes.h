@@ -0,0 +1,28 @@
+#ifndef _PROBES_H_
+#define _PROBES_H_
+
+/* Static tracepoints (USDT) of the provider "assembler", for perf and bpftrace:
+ *   file_start(char *file), file_end(char *file)     a file is compiled, in every mode
+ *   phase_begin(char *file, int phase)               file is NULL if it doesn't change, the phases are stats_phase
+ *   phase_end(int phase)
+ *   macro_expand(char *macro)                        a line is replaced by the body of the macro
+ *   symbol_insert(char *symbol, int address, int type)
+ *   symbol_miss(char *symbol)                        a lookup of a symbol which isn't in the table
+ *   diag(int line, char *text)                       an error or a warning
+ * With <sys/sdt.h> (the makefile defines HAVE_SDT if it exists) a probe is a nop and a note in the
+ * executable, so it costs nothing until a tracer attaches to it:
+ *   bpftrace -e 'usdt:./assembler:assembler:macro_expand { @[str(arg0)] = count(); }'
+ * Without it the probes compile to nothing and their arguments aren't evaluated. */
+
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define probe1(name, a) DTRACE_PROBE1(assembler, name, a)
+#define probe2(name, a, b) DTRACE_PROBE2(assembler, name, a, b)
+#define probe3(name, a, b, c) DTRACE_PROBE3(assembler, name, a, b, c)
+#else
+#define probe1(name, a) ((void)0)
+#define probe2(name, a, b) ((void)0)
+#define probe3(name, a, b, c) ((void)0)
+#endif
+
+#endif
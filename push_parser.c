@@ -0,0 +1,174 @@
+/*** push_parser.c parses and compiles am text which is pushed in chunks ***/
+#include "compile.h"
+#include "push_parser.h"
+#include "stats.h"
+
+extern per_thread int cnt_line;	/* line number to show in errors */
+extern per_thread bool has_error;	/* to prevent output file creation if an error was found */
+extern per_thread int ic;
+extern per_thread int dc;
+extern per_thread char *file_am_name;
+
+#define SAVED_LINES 256    /* first size of the saved lines */
+
+/* a line kept for the second iteration */
+typedef struct {
+    int line;
+    syntax_ast ast;
+} saved_line;
+
+struct push_context {
+    char *file_name;
+    push_parser parser;
+    int instruction[MAX_CODE];
+    int data_code[MAX_CODE];
+    node_ptr symbol_head;
+    saved_line *saved;     /* the lines of the second iteration */
+    int cnt_saved, size_saved;
+};
+
+/*** functions prototypes ***/
+
+/* Parses a line of the splitter and sends it to the handler */
+static void parse_line(char *line, int line_number, bool too_long, void *arg);
+
+/* Handler of the parser of a context */
+static void context_line(syntax_ast *ast, int line_number, void *arg);
+
+/* Checks if the line is needed by the second iteration */
+static bool needed_in_second_iteration(syntax_ast *ast);
+
+
+/* Prepares the parser to send the lines to the handler */
+void parser_init(push_parser *p, parsed_handler handler, void *arg) {
+    splitter_init(&p->splitter, parse_line, p);
+    p->handler = handler;
+    p->arg = arg;
+}
+
+/* Parses the next len bytes of the text */
+void parser_feed(push_parser *p, const char *bytes, int len) {
+    splitter_feed(&p->splitter, bytes, len);
+}
+
+/* Parses the last line, if it has no new line */
+void parser_finish(push_parser *p) {
+    splitter_finish(&p->splitter);
+}
+
+/* Parses a line of the splitter and sends it to the handler */
+static void parse_line(char *line, int line_number, bool too_long, void *arg) {
+    push_parser *p = (push_parser *)arg;
+    syntax_ast ast;
+
+    if (too_long) {
+        p->handler(NULL, line_number, p->arg);
+        return;
+    }
+    /* skip comment and empty line*/
+    if (comment_empty_line(line))
+        return;
+    ast = syntax_ast_parse(line);
+    p->handler(&ast, line_number, p->arg);
+}
+
+/* Starts the compile of a file, the outputs get the name of the file */
+push_context *push_begin(char *file_name) {
+    push_context *ctx = (push_context *)asm_malloc(sizeof(push_context));
+
+    valid_allocate(ctx);
+    ctx->file_name = (char *)asm_malloc(strlen(file_name) + 1);
+    valid_allocate(ctx->file_name);
+    strcpy(ctx->file_name, file_name);
+    parser_init(&ctx->parser, context_line, ctx);
+    ctx->symbol_head = NULL;
+    ctx->saved = NULL;
+    ctx->cnt_saved = ctx->size_saved = 0;
+
+    initialize_vars(ctx->instruction, ctx->data_code);
+    file_am_name = output_name(file_name, MACRO_FILE);
+    return ctx;
+}
+
+/* Compiles the next len bytes of the am text */
+void push_feed(push_context *ctx, const char *bytes, int len) {
+    stats_state prev = stats_enter(ctx->file_name, phase_first_iteration);
+
+    parser_feed(&ctx->parser, bytes, len);
+    stats_leave(prev);
+}
+
+/* Handler of the parser of a context */
+static void context_line(syntax_ast *ast, int line_number, void *arg) {
+    push_line((push_context *)arg, ast, line_number);
+}
+
+/* Compiles a line which was parsed elsewhere, ast NULL for a line which is too long */
+void push_line(push_context *ctx, syntax_ast *ast, int line_number) {
+    cnt_line = line_number;
+    if (ast == NULL) {
+        long_line_error();
+        return;
+    }
+    build_symbol_table(*ast, &ctx->symbol_head, ctx->data_code);
+
+    /* Operands may refer to symbols defined later, keep the line for the second iteration */
+    if (needed_in_second_iteration(ast)) {
+        if (ctx->cnt_saved == ctx->size_saved) {
+            ctx->size_saved = ctx->size_saved ? ctx->size_saved * 2 : SAVED_LINES;
+            ctx->saved = (saved_line *)asm_realloc(ctx->saved, ctx->size_saved * sizeof(saved_line));
+            valid_allocate(ctx->saved);
+        }
+        ctx->saved[ctx->cnt_saved].line = line_number;
+        ctx->saved[ctx->cnt_saved].ast = *ast;
+        ctx->cnt_saved++;
+    }
+}
+
+/* Ends the text, encodes the lines and writes the outputs if there were no errors */
+int push_finish(push_context *ctx) {
+    node_ptr extern_list = NULL;
+    node_ptr entry_list = NULL;
+    int i, ok;
+    stats_state prev = stats_enter(ctx->file_name, phase_first_iteration);
+
+    parser_finish(&ctx->parser);
+    finish_first_iteration(&ctx->symbol_head, ctx->data_code);
+    stats_enter(ctx->file_name, phase_second_iteration);
+
+    /* Second iteration over the saved lines, the symbol table is complete */
+    if (!has_error) {
+        ic = 0;
+        for (i = 0; i < ctx->cnt_saved; i++) {
+            cnt_line = ctx->saved[i].line;
+            second_iteration_line(&ctx->saved[i].ast, &ctx->symbol_head, &extern_list, &entry_list, ctx->instruction);
+        }
+        create_output_files(ctx->file_name, ctx->instruction, ctx->data_code, &entry_list, &extern_list);
+    }
+    ok = !has_error;
+
+    clear_list(&extern_list);
+    clear_list(&entry_list);
+    push_abort(ctx);
+    stats_leave(prev);
+    return ok;
+}
+
+/* Frees the context without writing any output */
+void push_abort(push_context *ctx) {
+    asm_free(file_am_name);
+    file_am_name = NULL;
+    clear_list(&ctx->symbol_head);
+    asm_free(ctx->saved);
+    asm_free(ctx->file_name);
+    asm_free(ctx);
+}
+
+/* Checks if the line is needed by the second iteration */
+static bool needed_in_second_iteration(syntax_ast *ast) {
+    if (*(ast->syntax_error) != '\0')
+        return FALSE;
+    if (ast->opt_ast == instruct)
+        return TRUE;
+    return ast->dir_inst.direct.dir_opt == opt_entry;
+}
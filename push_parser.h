@@ -0,0 +1,53 @@
+#ifndef _PUSH_PARSER_H_
+#define _PUSH_PARSER_H_
+
+#include "line_index.h"
+#include "syntax.h"
+
+/* Push parsing: the am text is given in chunks of any size, which don't have to
+ * end at a line, and every line is parsed as soon as it is complete.
+ *
+ * push_parser only parses, it sends the parsed lines to a handler.
+ * push_context compiles a file from the chunks: the first iteration handles every
+ * line when it is parsed, finish runs the second iteration and writes the outputs.
+ * A context uses the compile state of its thread (ic, dc, cnt_line, has_error),
+ * all its calls must be made on one thread and one file is compiled at a time. */
+
+/* receives a parsed line, ast is NULL if the line is longer than the allowed length */
+typedef void (*parsed_handler)(syntax_ast *ast, int line_number, void *arg);
+
+typedef struct {
+    line_splitter splitter; /* holds the partial line between the chunks */
+    parsed_handler handler;
+    void *arg;
+} push_parser;
+
+/* the compile of a file from pushed text */
+typedef struct push_context push_context;
+
+/* Prepares the parser to send the lines to the handler, comments and empty lines are skipped */
+void parser_init(push_parser *p, parsed_handler handler, void *arg);
+
+/* Parses the next len bytes of the text */
+void parser_feed(push_parser *p, const char *bytes, int len);
+
+/* Parses the last line, if it has no new line */
+void parser_finish(push_parser *p);
+
+/* Starts the compile of a file, the outputs get the name of the file */
+push_context *push_begin(char *file_name);
+
+/* Compiles the next len bytes of the am text */
+void push_feed(push_context *ctx, const char *bytes, int len);
+
+/* Ends the text, encodes the lines and writes the outputs if there were no errors.
+ * Frees the context, returns 0 if the file had errors */
+int push_finish(push_context *ctx);
+
+/* Frees the context without writing any output */
+void push_abort(push_context *ctx);
+
+/* Compiles a line which was parsed elsewhere, ast NULL for a line which is too long */
+void push_line(push_context *ctx, syntax_ast *ast, int line_number);
+
+#endif
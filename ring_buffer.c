@@ -0,0 +1,68 @@
+/* ring_buffer.c implements the lock-free single-producer/single-consumer queue */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "ring_buffer.h"
+#include "define.h"
+
+#define CACHE_LINE 64
+
+/* the indexes grow forever, the slot of an index is index & mask */
+struct ring_buffer {
+    char *slots;            /* capacity * slot_size bytes */
+    size_t slot_size;
+    unsigned long mask;     /* capacity - 1 */
+    unsigned long head;     /* next slot to read, written only by the consumer */
+    char pad[CACHE_LINE];   /* keeps head and tail on different cache lines */
+    unsigned long tail;     /* next slot to write, written only by the producer */
+};
+
+#define load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define slot_at(rb, index) ((rb)->slots + ((index) & (rb)->mask) * (rb)->slot_size)
+
+/* Creates a ring of capacity slots (rounded up to a power of 2) of slot_size bytes */
+ring_buffer *ring_create(size_t slot_size, unsigned long capacity) {
+    unsigned long size = 1;
+    ring_buffer *rb = (ring_buffer *)asm_calloc(1, sizeof(ring_buffer));
+    valid_allocate(rb);
+
+    while (size < capacity)
+        size <<= 1;
+    rb->slots = (char *)asm_calloc(size, slot_size);
+    valid_allocate(rb->slots);
+    rb->slot_size = slot_size;
+    rb->mask = size - 1;
+    return rb;
+}
+
+/* Frees the ring */
+void ring_destroy(ring_buffer *rb) {
+    asm_free(rb->slots);
+    asm_free(rb);
+}
+
+/* Producer: waits for a free slot and returns it */
+void *ring_reserve(ring_buffer *rb) {
+    while (rb->tail - load_acquire(&rb->head) > rb->mask)
+        sched_yield(); /* full, let the consumer run */
+    return slot_at(rb, rb->tail);
+}
+
+/* Producer: publishes the slot returned by ring_reserve */
+void ring_commit(ring_buffer *rb) {
+    store_release(&rb->tail, rb->tail + 1);
+}
+
+/* Consumer: waits for a published slot and returns it */
+void *ring_front(ring_buffer *rb) {
+    while (load_acquire(&rb->tail) == rb->head)
+        sched_yield(); /* empty, let the producer run */
+    return slot_at(rb, rb->head);
+}
+
+/* Consumer: returns the slot returned by ring_front to the producer */
+void ring_release(ring_buffer *rb) {
+    store_release(&rb->head, rb->head + 1);
+}
@@ -0,0 +1,30 @@
+#ifndef _RING_BUFFER_H_
+#define _RING_BUFFER_H_
+
+#include <stddef.h>
+
+/* A bounded single-producer/single-consumer queue of fixed size slots.
+ * The producer and the consumer never take a lock, each one owns one index
+ * and only reads the other one. Slots are filled and drained in place. */
+
+typedef struct ring_buffer ring_buffer;
+
+/* Creates a ring of capacity slots (rounded up to a power of 2) of slot_size bytes */
+ring_buffer *ring_create(size_t slot_size, unsigned long capacity);
+
+/* Frees the ring */
+void ring_destroy(ring_buffer *rb);
+
+/* Producer: waits for a free slot and returns it */
+void *ring_reserve(ring_buffer *rb);
+
+/* Producer: publishes the slot returned by ring_reserve */
+void ring_commit(ring_buffer *rb);
+
+/* Consumer: waits for a published slot and returns it */
+void *ring_front(ring_buffer *rb);
+
+/* Consumer: returns the slot returned by ring_front to the producer */
+void ring_release(ring_buffer *rb);
+
+#endif
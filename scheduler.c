@@ -0,0 +1,253 @@
+/* scheduler.c implements the work-stealing task scheduler */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "scheduler.h"
+#include "define.h"
+
+#define INITIAL_DEQUE 64
+
+typedef struct {
+    task_fn fn;
+    void *arg;
+    int index;
+} task;
+
+/* tasks of one worker, top is the oldest task and bottom - 1 the newest */
+typedef struct {
+    task *items;
+    int top, bottom, size;
+    pthread_mutex_t lock;
+} deque;
+
+typedef struct {
+    scheduler *s;
+    int id;
+    pthread_t thread;
+    deque tasks;
+} worker;
+
+struct scheduler {
+    worker *workers;
+    int cnt_workers;
+    int next_inject;       /* worker which gets the next task from outside */
+    int pending;           /* spawned tasks which are not done yet */
+    bool stop;
+    pthread_mutex_t lock;  /* protects pending and stop, and the sleeping */
+    pthread_cond_t wake;   /* signaled when a task is added or the scheduler stops */
+    pthread_cond_t done;   /* signaled when pending drops to 0 */
+};
+
+static per_thread worker *current = NULL; /* the worker running on this thread */
+
+/*** functions prototypes ***/
+
+/* Main loop of a worker thread */
+static void *worker_loop(void *arg);
+
+/* Takes a task from the own deque or steals one, returns 0 if there is no task */
+static int find_task(worker *w, task *t);
+
+/* Pushes a task at the bottom of the deque */
+static void deque_push(deque *d, task *t);
+
+/* Pops the newest task, returns 0 if the deque is empty */
+static int deque_pop(deque *d, task *t);
+
+/* Steals the oldest task, returns 0 if the deque is empty */
+static int deque_steal(deque *d, task *t);
+
+
+/* Starts a scheduler with the given number of worker threads */
+scheduler *scheduler_create(int cnt_workers) {
+    scheduler *s = (scheduler *)asm_calloc(1, sizeof(scheduler));
+    int i;
+    valid_allocate(s);
+
+    if (cnt_workers < 1)
+        cnt_workers = 1;
+    s->workers = (worker *)asm_calloc(cnt_workers, sizeof(worker));
+    valid_allocate(s->workers);
+    s->cnt_workers = cnt_workers;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    pthread_cond_init(&s->done, NULL);
+
+    for (i = 0; i < cnt_workers; i++) {
+        s->workers[i].s = s;
+        s->workers[i].id = i;
+        s->workers[i].tasks.items = (task *)asm_malloc(INITIAL_DEQUE * sizeof(task));
+        valid_allocate(s->workers[i].tasks.items);
+        s->workers[i].tasks.size = INITIAL_DEQUE;
+        pthread_mutex_init(&s->workers[i].tasks.lock, NULL);
+    }
+    for (i = 0; i < cnt_workers; i++) {
+        if (pthread_create(&s->workers[i].thread, NULL, worker_loop, &s->workers[i]) != 0) {
+            printf("Error: couldn't create the scheduler threads\n");
+            exit(1);
+        }
+    }
+    return s;
+}
+
+/* Adds a task, to the deque of the calling worker or to a worker's deque if called from another thread */
+void scheduler_spawn(scheduler *s, task_fn fn, void *arg, int index) {
+    task t;
+    worker *w = current;
+
+    t.fn = fn;
+    t.arg = arg;
+    t.index = index;
+
+    pthread_mutex_lock(&s->lock);
+    s->pending++;
+    if (w == NULL || w->s != s) {
+        w = &s->workers[s->next_inject];
+        s->next_inject = (s->next_inject + 1) % s->cnt_workers;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    deque_push(&w->tasks, &t);
+
+    /* Wake an idle worker to take or steal the task */
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_signal(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Waits until all the tasks, including the tasks they spawned, are done */
+void scheduler_wait(scheduler *s) {
+    pthread_mutex_lock(&s->lock);
+    while (s->pending > 0)
+        pthread_cond_wait(&s->done, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Number of worker threads */
+int scheduler_workers(scheduler *s) {
+    return s->cnt_workers;
+}
+
+/* Stops the workers and frees the scheduler */
+void scheduler_destroy(scheduler *s) {
+    int i;
+
+    scheduler_wait(s);
+    pthread_mutex_lock(&s->lock);
+    s->stop = TRUE;
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+
+    /* A worker may still look into the deques of the others until all are joined */
+    for (i = 0; i < s->cnt_workers; i++)
+        pthread_join(s->workers[i].thread, NULL);
+    for (i = 0; i < s->cnt_workers; i++) {
+        asm_free(s->workers[i].tasks.items);
+        pthread_mutex_destroy(&s->workers[i].tasks.lock);
+    }
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    pthread_cond_destroy(&s->done);
+    asm_free(s->workers);
+    asm_free(s);
+}
+
+/* Main loop of a worker thread */
+static void *worker_loop(void *arg) {
+    worker *w = (worker *)arg;
+    scheduler *s = w->s;
+    task t;
+
+    current = w;
+    for (;;) {
+        if (find_task(w, &t)) {
+            t.fn(t.arg, t.index);
+            pthread_mutex_lock(&s->lock);
+            if (--s->pending == 0)
+                pthread_cond_broadcast(&s->done);
+            pthread_mutex_unlock(&s->lock);
+            continue;
+        }
+        /* No task anywhere, sleep until one is spawned. The check is repeated
+         * under the lock, a spawn signals only after its task is pushed */
+        pthread_mutex_lock(&s->lock);
+        while (!s->stop && !find_task(w, &t))
+            pthread_cond_wait(&s->wake, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+        if (s->stop)
+            break;
+        t.fn(t.arg, t.index);
+        pthread_mutex_lock(&s->lock);
+        if (--s->pending == 0)
+            pthread_cond_broadcast(&s->done);
+        pthread_mutex_unlock(&s->lock);
+    }
+    current = NULL;
+    return NULL;
+}
+
+/* Takes a task from the own deque or steals one, returns 0 if there is no task */
+static int find_task(worker *w, task *t) {
+    scheduler *s = w->s;
+    int i;
+
+    if (deque_pop(&w->tasks, t))
+        return 1;
+    /* Steal from the other workers, starting after this one */
+    for (i = 1; i < s->cnt_workers; i++) {
+        if (deque_steal(&s->workers[(w->id + i) % s->cnt_workers].tasks, t))
+            return 1;
+    }
+    return 0;
+}
+
+/* Pushes a task at the bottom of the deque */
+static void deque_push(deque *d, task *t) {
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom == d->size) {
+        /* Move the tasks to the start, grow if the deque is really full */
+        if (d->top > 0) {
+            memmove(d->items, d->items + d->top, (d->bottom - d->top) * sizeof(task));
+            d->bottom -= d->top;
+            d->top = 0;
+        } else {
+            d->size *= 2;
+            d->items = (task *)asm_realloc(d->items, d->size * sizeof(task));
+            valid_allocate(d->items);
+        }
+    }
+    d->items[d->bottom++] = *t;
+    pthread_mutex_unlock(&d->lock);
+}
+
+/* Pops the newest task, returns 0 if the deque is empty */
+static int deque_pop(deque *d, task *t) {
+    int found = 0;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) {
+        *t = d->items[--d->bottom];
+        found = 1;
+    }
+    if (d->bottom == d->top)
+        d->top = d->bottom = 0;
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/* Steals the oldest task, returns 0 if the deque is empty */
+static int deque_steal(deque *d, task *t) {
+    int found = 0;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) {
+        *t = d->items[d->top++];
+        found = 1;
+    }
+    if (d->bottom == d->top)
+        d->top = d->bottom = 0;
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
@@ -0,0 +1,28 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+/* A work-stealing task scheduler. Every worker thread has its own deque of tasks:
+ * the worker pushes and pops at the bottom (newest first), idle workers steal
+ * from the top (oldest first) of the other deques. */
+
+typedef struct scheduler scheduler;
+
+/* a task receives its argument and an index, e.g. the number of a chunk */
+typedef void (*task_fn)(void *arg, int index);
+
+/* Starts a scheduler with the given number of worker threads */
+scheduler *scheduler_create(int cnt_workers);
+
+/* Adds a task, to the deque of the calling worker or to a worker's deque if called from another thread */
+void scheduler_spawn(scheduler *s, task_fn fn, void *arg, int index);
+
+/* Waits until all the tasks, including the tasks they spawned, are done */
+void scheduler_wait(scheduler *s);
+
+/* Number of worker threads */
+int scheduler_workers(scheduler *s);
+
+/* Stops the workers and frees the scheduler */
+void scheduler_destroy(scheduler *s);
+
+#endif
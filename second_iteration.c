@@ -1,48 +1,33 @@
 /*** second_iteration.c file encode instruction assembly code and creates output files ***/
 #include "compile.h"
+#include "line_index.h"
+#include "emit.h"
+#include "stats.h"
 
 /*** Global vars ***/
-extern int cnt_line;	/* line number to show in errors */
-extern bool has_error;	/* to prevent output file creation if an error was found */
-extern int ic;
-extern int dc;
-extern char *file_am_name;
+extern per_thread int cnt_line;	/* line number to show in errors */
+extern per_thread bool has_error;	/* to prevent output file creation if an error was found */
+extern per_thread int ic;
+extern per_thread int dc;
+extern per_thread char *file_am_name;
 
 /*** functions prototypes ***/
 
-/* Encode the command portion of an assembly line */
-void encode_command(syntax_ast ast, int instruction[]);
-
-/* Encode the operands of an assembly line */
-void encode_operands(syntax_ast ast, node_ref symbol_head, node_ref extern_list, int instruction[]);
-
-/* Add an entry symbol to the entry list */
-void add_entry(char symbol[], node_ref symbol_head, node_ref entry_list);
-
-/* Extract specific bits from an unsigned integer */
-unsigned int extract_bits(unsigned int number, int startBit, int numBits);
-
-/* Convert an unsigned integer to base-64 representation */
-char *convert_to_base_64(unsigned int num);
-
-/* Create an object file from encoded instructions and data */
-void create_obj_file(char *name, int instruction[], int data_code[]);
-
-/* Create entry/external files for symbols */
-void create_ent_ext_file(char *name, node_ref list, char *suffix);
 
 
 /*ecoding the instructions sentences according to symbol table an creates output files */
 void second_iteration(char *file_name, FILE *am_file, node_ref symbol_head, int instruction[], int data_code[]) {
     syntax_ast line_ast = {0}; /* Syntax AST structure to hold parsed line */
-    char line_buffer[MAX_LINE_LENGTH] = {0}; /* Buffer to read each line */
+    char *line_buffer = NULL; /* Buffer to read each line */
+    int size;
     node_ptr extern_list = NULL; /* List of external symbols */
     node_ptr entry_list = NULL; /* List of entry symbols */
+    stats_state prev = stats_enter(file_name, phase_second_iteration);
     ic = 0; /* Initialize instruction counter */
     cnt_line = 0; /* Initialize line counter */
     
     /* Loop through each line in the assembly file */
-    while (fgets(line_buffer, sizeof(line_buffer), am_file)) {
+    while (read_line(am_file, &line_buffer, &size)) {
         cnt_line++; /* Increment line counter */
 
         /* Skip empty lines and comments */
@@ -52,37 +37,52 @@ void second_iteration(char *file_name, FILE *am_file, node_ref symbol_head, int
 
         /* Parse the line and obtain the syntax AST */
         line_ast = syntax_ast_parse(line_buffer);
-
-        switch (line_ast.opt_ast) {
-            case instruct:
-                /* Process and encode instruction lines */
-                encode_command(line_ast, instruction);
-                encode_operands(line_ast, symbol_head, &extern_list, instruction);
-                break;
-            case direct:
-                if (line_ast.dir_inst.direct.dir_opt == opt_entry) {
-                    /* Add labels as entry symbols */
-                    add_entry(line_ast.dir_inst.direct.direct_params.symbol, symbol_head, &entry_list);
-                } else {
-                    continue; /* Skip other directive types */
-                }
-        }
+        second_iteration_line(&line_ast, symbol_head, &extern_list, &entry_list, instruction);
     }
+    asm_free(line_buffer);
 
     /* Generate output files if no errors were encountered */
-    if (!has_error) {
-        create_obj_file(file_name, instruction, data_code);
-        if (entry_list != NULL) {
-            create_ent_ext_file(file_name, &entry_list, ENTRIES_FILE);
-        }
-        if (extern_list != NULL) {
-            create_ent_ext_file(file_name, &extern_list, EXTERN_FILE);
-        }
-    }
+    create_output_files(file_name, instruction, data_code, &entry_list, &extern_list);
 
     /* Clear the lists and free memory */
     clear_list(&extern_list);
     clear_list(&entry_list);
+    stats_leave(prev);
+}
+
+/* Encode a single parsed line of the second iteration */
+void second_iteration_line(syntax_ast *line_ast, node_ref symbol_head, node_ref extern_list, node_ref entry_list, int instruction[]) {
+    switch (line_ast->opt_ast) {
+        case instruct:
+            /* Process and encode instruction lines */
+            encode_command(*line_ast, instruction);
+            encode_operands(*line_ast, symbol_head, extern_list, instruction);
+            break;
+        case direct:
+            if (line_ast->dir_inst.direct.dir_opt == opt_entry) {
+                /* Add labels as entry symbols */
+                add_entry(line_ast->dir_inst.direct.direct_params.symbol, symbol_head, entry_list);
+            }
+            break;
+    }
+}
+
+/* Create the output files if no errors were encountered */
+void create_output_files(char *file_name, int instruction[], int data_code[], node_ref entry_list, node_ref extern_list) {
+    asm_image image;
+    stats_state prev = stats_enter(file_name, phase_output);
+
+    if (!has_error) {
+        image.file_name = file_name;
+        image.ic = ic;
+        image.dc = dc;
+        image.instruction = instruction;
+        image.data_code = data_code;
+        image.entry_list = entry_list;
+        image.extern_list = extern_list;
+        emit_image(&image);
+    }
+    stats_leave(prev);
 }
 
 
@@ -135,7 +135,7 @@ void encode_operands(syntax_ast ast, node_ref symbol_head, node_ref extern_list,
                         found_symbol = get_symbol(symbol_head, ast.dir_inst.instruct.op_opt[i].symbol);
 
                         if (!found_symbol) {
-                            printf("\nError in %s, line %d: use of symbol as operand but the symbol was never defined\n", file_am_name,cnt_line);
+                            diag_printf("\nError in %s, line %d: use of symbol as operand but the symbol was never defined\n", file_am_name,cnt_line);
                             has_error = TRUE; /* Set error flag */
                             return;
                         }
@@ -173,7 +173,7 @@ void add_entry(char symbol[], node_ref symbol_head, node_ref entry_list) {
     found_symbol = get_symbol(symbol_head, symbol);
 
     if (!found_symbol) {
-        printf("\nError in %s, line %d: declaration of symbol as entry but symbol does not exist\n",file_am_name,cnt_line);
+        diag_printf("\nError in %s, line %d: declaration of symbol as entry but symbol does not exist\n",file_am_name,cnt_line);
         has_error = TRUE; /* Set error flag */
         return;
     }
@@ -183,103 +183,3 @@ void add_entry(char symbol[], node_ref symbol_head, node_ref entry_list) {
     /* Add the symbol to the entry list with its address and name */
     add_symbol(entry_list, get_address(found_symbol), get_symbol_name(found_symbol), entry);
 }
-
-
- /* Extract a specific range of bits from an unsigned integer */
-unsigned int extract_bits(unsigned int  number, int startBit, int numBits) {
-    /* Create a bitmask to extract the desired bits*/
-    unsigned int bitmask = ((1 << numBits) - 1) << startBit;
-
-    /* Extract the desired bits using bitwise AND*/
-    unsigned int extractedBits = (number & bitmask) >> startBit;
-
-    return extractedBits;
-}
-
-/* Converting a word to 2 digits in base 64 (as a string) */
-char *convert_to_base_64(unsigned int num)
-{
-    char *obj; /* Pointer to the result string in base 64 */
-    char base64[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"; /* Base 64 characters */
-    obj = (char*)calloc(3, sizeof(char)); /* Allocate memory for the result string */
-
-    /* Convert the input number to base 64 representation */
-    obj[0] = base64[extract_bits(num, 6, 6)]; /* Extract and map first 6 bits */
-    obj[1] = base64[extract_bits(num, 0, 6)]; /* Extract and map next 6 bits */
-    obj[2] = '\0'; /* Null-terminate the result string */
-
-    return obj; /* Return the base 64 representation as a string */
-}
-
-
-void create_obj_file(char *name, int instruction[], int data_code[]) {
-    /* Create and write to the object file */
-
-    char *temp1; /* Temporary string for base 64 conversion */
-    int i;
-    FILE *obj_file;
-    char *obj_file_name = name_file(name, OBJECT_FILE); /* Construct the object file name */
-    obj_file = fopen(obj_file_name, "w"); /* Open the object file for writing */
-
-    if (obj_file == NULL) {
-        printf("Error: could not open objects file");
-        exit(1); /* Exit if file opening fails */
-    }
-
-    free(obj_file_name); /* Free the allocated memory for file name */
-
-    fprintf(obj_file, "\n%d %d", ic, dc); /* Write the values of ic and dc */
-
-    /* Write instructions to the object file */
-    for (i = 0; i < ic; i++) {
-        temp1 = convert_to_base_64(instruction[i]); /* Convert instruction to base 64 */
-        fprintf(obj_file, "\n%s", temp1); /* Write the converted instruction */
-        free(temp1); /* Free the temporary string memory */
-    }
-
-    /* Write data code to the object file */
-    for (i = 0; i < dc; i++) {
-        temp1 = convert_to_base_64(data_code[i]); /* Convert data code to base 64 */
-        fprintf(obj_file, "\n%s", temp1); /* Write the converted data code */
-        free(temp1); /* Free the temporary string memory */
-    }
-
-    fclose(obj_file); /* Close the object file */
-}
-
-
-void create_ent_ext_file(char *name, node_ref list, char *suffix) {
-    /* Create and write to an entry or external file */
-
-    FILE *fp;
-    symbol_node* curr_symbol;
-    node_ptr temp; /* Iterator */
-    char *file_name = name_file(name, suffix); /* Construct the file name */
-
-    fp = fopen(file_name, "w"); /* Open the file for writing */
-
-    if (fp == NULL) {
-        printf("Error: could not open file");
-        exit(1); /* Exit if file opening fails */
-    }
-
-    free(file_name); /* Free the allocated memory for file name */
-
-    temp = *list; /* Start from the head of the list */
-
-    if (temp == NULL)
-        return; /* Return if the list is empty */
-
-    do {
-        curr_symbol = (symbol_node *)(get_data(temp)); /* Get the symbol node data */
-        fprintf(fp, "\n%s\t%d", get_symbol_name(curr_symbol), get_address(curr_symbol));
-        /* Write symbol name and address to the file */
-
-    } while ((temp = get_next(temp)) != NULL); /* Iterate through the list */
-
-    fclose(fp); /* Close the file */
-}
-
-
-
- 
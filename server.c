@@ -0,0 +1,162 @@
+/*** server.c compiles the requests it gets on a unix domain socket ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "define.h"
+#include "options.h"
+#include "diag.h"
+#include "scheduler.h"
+#include "thread_pool.h"
+#include "batch.h"
+#include "server.h"
+
+#define MAX_CONNECTIONS 16
+
+/*** functions prototypes ***/
+
+/* Reads a request, compiles its files and sends the answer */
+static void handle_request(int fd, scheduler *s, asm_options *base);
+
+/* Compiles the command line of a request, returns its exit status */
+static int run_request(scheduler *s, int argc, char *argv[], asm_options *base);
+
+/* Checks that a request sets no mode the server can't honor, returns 0 and prints an error if it does */
+static int request_modes_valid(asm_options *base);
+
+
+/* Serves requests on the socket until killed, returns the exit status */
+int serve(char *socket_path) {
+    struct sockaddr_un addr;
+    asm_options base = options;
+    scheduler *s;
+    int listener, fd;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("Error: socket path is too long: %s\n", socket_path);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path); /* a socket left by a previous server */
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listener, MAX_CONNECTIONS) < 0) {
+        printf("Error: can't listen on socket: %s\n", socket_path);
+        return 1;
+    }
+    /* A client which goes away must not kill the server */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* The workers stay warm between the requests */
+    s = scheduler_create(default_jobs());
+    for (;;) {
+        fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+            continue;
+        handle_request(fd, s, &base);
+    }
+    return 0;
+}
+
+/* Reads a request, compiles its files and sends the answer */
+static void handle_request(int fd, scheduler *s, asm_options *base) {
+    FILE *in;
+    char *line = NULL, **argv;
+    size_t line_size = 0;
+    long len;
+    int argc = 1, size_argv = 16, status;
+    diag_buffer out = {0}, *prev;
+    char header[64];
+
+    argv = (char **)asm_calloc(size_argv, sizeof(char *));
+    valid_allocate(argv);
+    argv[0] = "assembler";
+
+    in = fdopen(fd, "r");
+    prev = diag_redirect(&out);
+    while ((len = getline(&line, &line_size, in)) > 0) {
+        if (line[len - 1] == '\n')
+            line[--len] = '\0';
+        if (strcmp(line, "end") == 0)
+            break;
+        if (strncmp(line, "cwd ", 4) == 0) {
+            /* The requests are handled one at a time, so the directory may change */
+            if (chdir(line + 4) != 0)
+                diag_printf("Error: can't change to directory %s\n", line + 4);
+        } else if (strncmp(line, "arg ", 4) == 0) {
+            if (argc + 1 >= size_argv) {
+                size_argv *= 2;
+                argv = (char **)asm_realloc(argv, size_argv * sizeof(char *));
+                valid_allocate(argv);
+            }
+            argv[argc] = (char *)asm_malloc(len - 3);
+            valid_allocate(argv[argc]);
+            strcpy(argv[argc++], line + 4);
+        }
+    }
+    argv[argc] = NULL;
+
+    /* Every request starts from the options the server was started with */
+    options = *base;
+    status = run_request(s, argc, argv, base);
+    options = *base;
+    diag_redirect(prev);
+
+    /* The answer */
+    sprintf(header, "status %d\ndiag %ld\n", status, out.len);
+    if (write(fd, header, strlen(header)) >= 0 && out.len > 0 && write(fd, out.text, out.len) < 0)
+        ; /* the client went away */
+
+    diag_clear(&out);
+    for (argc = 1; argv[argc] != NULL; argc++)
+        asm_free(argv[argc]);
+    asm_free(argv);
+    asm_free(line);
+    fclose(in);
+}
+
+/* Compiles the command line of a request, returns its exit status */
+static int run_request(scheduler *s, int argc, char *argv[], asm_options *base) {
+    char **files;
+    int cnt, i, status;
+
+    /* parse_options reorders argv, keep the pointers for freeing */
+    files = (char **)asm_calloc(argc + 1, sizeof(char *));
+    valid_allocate(files);
+    for (i = 0; i < argc; i++)
+        files[i] = argv[i];
+    cnt = parse_options(argc, files);
+    if (cnt < 0 || !request_modes_valid(base)) {
+        asm_free(files);
+        return 1;
+    }
+    if (cnt < 2) {
+        diag_printf("No input file received.");
+        asm_free(files);
+        return 1;
+    }
+    status = assemble_on(s, files + 1, cnt - 1);
+    asm_free(files);
+    return status;
+}
+
+/* Checks that a request sets no mode the server can't honor, returns 0 and prints an error if it does.
+ * The files of a request always go to the warm scheduler of the server, so the modes of compiling,
+ * the threads, the I/O backend and the reports of the process are the ones the server was started with */
+static int request_modes_valid(asm_options *base) {
+    if (options.pipeline == base->pipeline && options.parallel == base->parallel &&
+        options.incremental == base->incremental && options.watch == base->watch &&
+        options.stdio == base->stdio && options.serve == base->serve && options.jobs == base->jobs &&
+        options.io == base->io && options.stats == base->stats && options.stats_json == base->stats_json &&
+        options.trace == base->trace && options.alloc_report == base->alloc_report)
+        return 1;
+    diag_printf("Error: --pipeline, --parallel, --incremental, --watch, --stdio, --serve, --jobs, --io, --stats, "
+                "--stats-json, --trace and --alloc-report can't be used in a request to the server\n");
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+/* Server mode: the assembler stays up and compiles the requests it gets on a
+ * unix domain socket, with warm worker threads.
+ *
+ * A request is made of text lines, the client closes its side after "end":
+ *     cwd <directory the paths are relative to>
+ *     arg <a command line argument, an option or a file name>   (any number)
+ *     end
+ * The answer is:
+ *     status <exit status of the plain assembler>
+ *     diag <length>
+ *     <the diagnostics, length bytes> */
+
+/* Serves requests on the socket until killed, returns the exit status */
+int serve(char *socket_path);
+
+#endif
@@ -0,0 +1,309 @@
+/*** stats.c collects the times and the counters of --stats ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "define.h"
+#include "options.h"
+#include "trace.h"
+#include "probes.h"
+#include "stats.h"
+
+#define MILLI 1000.0
+
+/* the statistics of a file */
+typedef struct stats_file {
+    char *name;
+    double wall[cnt_phases], cpu[cnt_phases];  /* seconds */
+    long counters[cnt_counters];
+} stats_file;
+
+/* the clocks of a thread at the last charge */
+typedef struct {
+    struct timespec wall, cpu;
+    stats_state state;
+    bool started;
+} thread_clock;
+
+static const char *phase_names[] = {"pre_processor", "first_iteration", "second_iteration", "output"};
+static const char *counter_names[] = {"lines", "macro_expansions", "symbols_inserted", "symbols_looked_up",
+                                      "allocations", "bytes_read", "bytes_written", "data_words_pooled",
+                                      "lines_reused", "lines_encoded"};
+
+per_thread long stats_counters[cnt_counters];
+static per_thread thread_clock clock_of_thread;
+
+static bool stats_on = FALSE;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static stats_file **files = NULL;
+static int cnt_files = 0, size_files = 0;
+static struct timespec run_start;
+
+/*** functions prototypes ***/
+
+/* Finds the statistics of the file, adds them if they are new, called with the lock */
+static stats_file *file_stats(char *file_name);
+
+/* Charges the time and the counters of the thread since the last charge */
+static void charge();
+
+/* Records the begin of the state of the thread on the timeline */
+static void trace_begin_state();
+
+/* Seconds between two times */
+static double seconds(struct timespec *from, struct timespec *to);
+
+/* Prints the statistics of a file, or of the total */
+static void print_text(FILE *out, stats_file *st, const char *title, double wall);
+
+/* Prints the statistics of a file, or of the total, as a JSON object */
+static void print_json(FILE *out, stats_file *st, double wall);
+
+/* Prints a JSON string */
+static void print_json_string(FILE *out, const char *text);
+
+/* Sum of the wall times of the phases */
+static double phases_wall(stats_file *st);
+
+
+/* Starts collecting the statistics of the files, in this order */
+void stats_start(char *names[], int cnt) {
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+    pthread_mutex_lock(&stats_lock);
+    for (i = 0; i < cnt; i++)
+        file_stats(names[i]);
+    pthread_mutex_unlock(&stats_lock);
+    stats_on = TRUE;
+}
+
+/* Charges the time of the thread so far, from now on it works on the file and the phase */
+stats_state stats_enter(char *file_name, stats_phase phase) {
+    thread_clock *tc = &clock_of_thread;
+    stats_state prev = tc->state;
+
+    probe2(phase_begin, file_name, (int)phase);
+    if (!stats_on) {
+        tc->state.phase = phase;
+        return prev;
+    }
+    charge();
+    if (file_name != NULL && (tc->state.file == NULL || strcmp(tc->state.file->name, file_name) != 0)) {
+        pthread_mutex_lock(&stats_lock);
+        tc->state.file = file_stats(file_name);
+        pthread_mutex_unlock(&stats_lock);
+    }
+    tc->state.phase = phase;
+    trace_begin_state();
+    return prev;
+}
+
+/* Charges the time of the thread so far and returns to the state before stats_enter */
+void stats_leave(stats_state prev) {
+    probe1(phase_end, (int)clock_of_thread.state.phase);
+    if (!stats_on) {
+        clock_of_thread.state.phase = prev.phase;
+        return;
+    }
+    charge();
+    clock_of_thread.state = prev;
+    trace_begin_state();
+}
+
+/* Charges the time and the counters of the thread since the last charge */
+static void charge() {
+    thread_clock *tc = &clock_of_thread;
+    stats_file *st = tc->state.file;
+    struct timespec wall, cpu;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    stats_counters[stat_allocations] += cnt_allocations;
+    cnt_allocations = 0;
+    if (st != NULL) {
+        pthread_mutex_lock(&stats_lock);
+        if (tc->started && tc->state.phase != phase_none) {
+            st->wall[tc->state.phase] += seconds(&tc->wall, &wall);
+            st->cpu[tc->state.phase] += seconds(&tc->cpu, &cpu);
+        }
+        for (i = 0; i < cnt_counters; i++)
+            st->counters[i] += stats_counters[i];
+        pthread_mutex_unlock(&stats_lock);
+        if (tc->started && tc->state.phase != phase_none && trace_on())
+            trace_event('E', phase_names[tc->state.phase], st->name, &wall);
+    }
+    /* What the thread did for no file isn't counted */
+    for (i = 0; i < cnt_counters; i++)
+        stats_counters[i] = 0;
+    tc->wall = wall;
+    tc->cpu = cpu;
+    tc->started = TRUE;
+}
+
+/* Records the begin of the state of the thread on the timeline */
+static void trace_begin_state() {
+    thread_clock *tc = &clock_of_thread;
+
+    if (tc->state.file != NULL && tc->state.phase != phase_none && trace_on())
+        trace_event('B', phase_names[tc->state.phase], tc->state.file->name, &tc->wall);
+}
+
+/* Prints the statistics, as text with --stats and as JSON to the --stats-json file, writes the --trace file and frees them */
+void stats_report() {
+    stats_file total;
+    struct timespec now;
+    double wall;
+    FILE *out;
+    int i, j;
+
+    if (!stats_on)
+        return;
+    stats_leave(clock_of_thread.state);
+    trace_finish();
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    wall = seconds(&run_start, &now);
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < cnt_files; i++) {
+        for (j = 0; j < cnt_phases; j++) {
+            total.wall[j] += files[i]->wall[j];
+            total.cpu[j] += files[i]->cpu[j];
+        }
+        for (j = 0; j < cnt_counters; j++)
+            total.counters[j] += files[i]->counters[j];
+    }
+
+    if (options.stats) {
+        printf("\n\nStatistics\n");
+        for (i = 0; i < cnt_files; i++)
+            print_text(stdout, files[i], files[i]->name, phases_wall(files[i]));
+        print_text(stdout, &total, "total", wall);
+    }
+
+    if (options.stats_json != NULL) {
+        out = strcmp(options.stats_json, "-") == 0 ? stdout : fopen(options.stats_json, "w");
+        if (out == NULL) {
+            printf("Error: can't create file: %s\n", options.stats_json);
+        } else {
+            fprintf(out, "{\"files\": [");
+            for (i = 0; i < cnt_files; i++) {
+                fprintf(out, i > 0 ? ",\n  " : "\n  ");
+                print_json(out, files[i], phases_wall(files[i]));
+            }
+            fprintf(out, "\n],\n\"total\": ");
+            print_json(out, &total, wall);
+            fprintf(out, "\n}\n");
+            if (out != stdout)
+                fclose(out);
+        }
+    }
+    fflush(stdout);
+
+    /* the run is over, the statistics aren't collected any more */
+    stats_on = FALSE;
+    for (i = 0; i < cnt_files; i++) {
+        asm_free(files[i]->name);
+        asm_free(files[i]);
+    }
+    asm_free(files);
+    files = NULL;
+    cnt_files = size_files = 0;
+}
+
+/* Finds the statistics of the file, adds them if they are new, called with the lock */
+static stats_file *file_stats(char *file_name) {
+    stats_file *st;
+    int i;
+
+    for (i = 0; i < cnt_files; i++) {
+        if (strcmp(files[i]->name, file_name) == 0)
+            return files[i];
+    }
+    if (cnt_files == size_files) {
+        size_files = size_files == 0 ? 16 : size_files * 2;
+        files = (stats_file **)asm_realloc(files, size_files * sizeof(stats_file *));
+        valid_allocate(files);
+    }
+    st = (stats_file *)asm_calloc(1, sizeof(stats_file));
+    valid_allocate(st);
+    st->name = (char *)asm_malloc(strlen(file_name) + 1);
+    valid_allocate(st->name);
+    strcpy(st->name, file_name);
+    files[cnt_files++] = st;
+    return st;
+}
+
+/* Seconds between two times */
+static double seconds(struct timespec *from, struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/* Sum of the wall times of the phases */
+static double phases_wall(stats_file *st) {
+    double sum = 0;
+    int i;
+
+    for (i = 0; i < cnt_phases; i++)
+        sum += st->wall[i];
+    return sum;
+}
+
+/* Prints the statistics of a file, or of the total */
+static void print_text(FILE *out, stats_file *st, const char *title, double wall) {
+    int i;
+
+    fprintf(out, "%s: %ld lines in %.3f ms, %.0f lines/s\n", title, st->counters[stat_lines], wall * MILLI,
+            wall > 0 ? st->counters[stat_lines] / wall : 0.0);
+    fprintf(out, "    %-18s %10s %10s\n", "phase", "wall ms", "cpu ms");
+    for (i = 0; i < cnt_phases; i++)
+        fprintf(out, "    %-18s %10.3f %10.3f\n", phase_names[i], st->wall[i] * MILLI, st->cpu[i] * MILLI);
+    fprintf(out, "    macro expansions %ld, symbols inserted %ld, symbols looked up %ld\n",
+            st->counters[stat_macro_expansions], st->counters[stat_symbols_inserted], st->counters[stat_symbols_looked_up]);
+    fprintf(out, "    allocations %ld, bytes read %ld, bytes written %ld\n",
+            st->counters[stat_allocations], st->counters[stat_bytes_read], st->counters[stat_bytes_written]);
+    if (st->counters[stat_data_words_pooled] > 0)
+        fprintf(out, "    data words pooled %ld\n", st->counters[stat_data_words_pooled]);
+    if (st->counters[stat_lines_reused] + st->counters[stat_lines_encoded] > 0)
+        fprintf(out, "    instructions reused %ld, encoded again %ld\n", st->counters[stat_lines_reused],
+                st->counters[stat_lines_encoded]);
+}
+
+/* Prints the statistics of a file, or of the total, as a JSON object */
+static void print_json(FILE *out, stats_file *st, double wall) {
+    int i;
+
+    fprintf(out, "{");
+    if (st->name != NULL) {
+        fprintf(out, "\"name\": ");
+        print_json_string(out, st->name);
+        fprintf(out, ", ");
+    } else {
+        fprintf(out, "\"files\": %d, ", cnt_files);
+    }
+    fprintf(out, "\"wall_ms\": %.3f, \"lines_per_second\": %.1f, \"phases\": {", wall * MILLI,
+            wall > 0 ? st->counters[stat_lines] / wall : 0.0);
+    for (i = 0; i < cnt_phases; i++)
+        fprintf(out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i > 0 ? ", " : "", phase_names[i],
+                st->wall[i] * MILLI, st->cpu[i] * MILLI);
+    fprintf(out, "}");
+    for (i = 0; i < cnt_counters; i++)
+        fprintf(out, ", \"%s\": %ld", counter_names[i], st->counters[i]);
+    fprintf(out, "}");
+}
+
+/* Prints a JSON string */
+static void print_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\')
+            fprintf(out, "\\%c", *text);
+        else if ((unsigned char)*text < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char)*text);
+        else
+            fputc(*text, out);
+    }
+    fputc('"', out);
+}
@@ -0,0 +1,61 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "define.h"
+
+/* Statistics of the run (--stats, --stats-json): for every file the wall and cpu
+ * time of each phase and the counters below, and their totals.
+ *
+ * A thread charges its time to the file and the phase it entered last. The time of
+ * a phase whose work is split between threads is the sum over the threads.
+ * The counters are kept per thread and charged with the time. */
+
+typedef enum {
+    phase_none = -1,
+    phase_pre_processor,
+    phase_first_iteration,
+    phase_second_iteration,
+    phase_output,
+    cnt_phases
+} stats_phase;
+
+typedef enum {
+    stat_lines,            /* lines of the sources */
+    stat_macro_expansions,
+    stat_symbols_inserted,
+    stat_symbols_looked_up,
+    stat_allocations,      /* heap allocations */
+    stat_bytes_read,
+    stat_bytes_written,
+    stat_data_words_pooled, /* data words removed by --dedup-data */
+    stat_lines_reused,     /* instructions whose words --incremental kept */
+    stat_lines_encoded,    /* instructions which --incremental encoded again */
+    cnt_counters
+} stats_counter;
+
+/* the file and the phase a thread works on */
+typedef struct {
+    struct stats_file *file;
+    stats_phase phase;
+} stats_state;
+
+/* the counters of the thread which were not charged yet */
+extern per_thread long stats_counters[cnt_counters];
+
+/* Adds n to a counter of the thread */
+#define stats_count(counter, n) (stats_counters[counter] += (n))
+
+/* Starts collecting the statistics of the files, in this order */
+void stats_start(char *files[], int cnt);
+
+/* Charges the time of the thread so far, from now on it works on the file (NULL for the
+ * same file) and the phase. Returns the previous state for stats_leave */
+stats_state stats_enter(char *file_name, stats_phase phase);
+
+/* Charges the time of the thread so far and returns to the state before stats_enter */
+void stats_leave(stats_state prev);
+
+/* Prints the statistics, as text with --stats and as JSON to the --stats-json file, writes the --trace file and frees them */
+void stats_report();
+
+#endif
@@ -0,0 +1,253 @@
+/*** stream.c compiles a source from stdin and writes all the outputs to stdout ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "define.h"
+#include "options.h"
+#include "diag.h"
+#include "compile.h"
+#include "pre_processor.h"
+#include "pipeline.h"
+#include "async_io.h"
+#include "stats.h"
+#include "stream.h"
+#include "probes.h"
+
+#define STREAM_FORMAT "asm-stream 1"
+#define MAX_STREAM_FILES 16
+#define READ_CHUNK 65536
+
+extern per_thread bool has_error;
+
+/* a file in memory */
+typedef struct {
+    char *name;
+    char *text;
+    size_t len;
+    FILE *fp;              /* open for writing, NULL when the file is complete */
+} memory_file;
+
+/* The stream mode compiles a single source on the main thread, the pipelined
+ * mode writes the am_file on its expander thread before the encoder reads it */
+static bool stream_on = FALSE;
+static memory_file files[MAX_STREAM_FILES];
+static int cnt_files = 0;
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*** functions prototypes ***/
+
+/* Reads all of the stream, returns NULL if it can't be read */
+static char *read_all(FILE *fp, size_t *len);
+
+/* Finds the complete file of the name, or the first one if none is complete, NULL if there is none */
+static memory_file *find_file(char *name);
+
+/* Frees a file and removes it from the list */
+static void remove_file(int i);
+
+/* Writes a section of the stream */
+static void write_section(FILE *out, const char *type, const char *text, size_t len);
+
+
+/* Compiles stdin and writes the stream to stdout, returns 1 on a fatal error */
+int assemble_stream(char *file_name) {
+    diag_buffer diag = {0}, *prev;
+    jmp_buf fatal, *prev_fatal;
+    memory_file *source;
+    char *dot;
+    int i, ok = 1, failed = 0;
+
+    stream_on = TRUE;
+    source = &files[cnt_files++];
+    source->name = name_file(file_name, INPUT_FILE);
+    source->fp = NULL;
+    if ((source->text = read_all(stdin, &source->len)) == NULL) {
+        printf("Error: can't read the source from stdin\n");
+        return 1;
+    }
+
+    /* Compile like a file, the errors are a section of the stream */
+    probe1(file_start, file_name);
+    prev = diag_redirect(&diag);
+    prev_fatal = catch_fatal(&fatal);
+    if (setjmp(fatal) == 0) {
+        if (options.pipeline) {
+            ok = compile_pipelined(file_name);
+        } else {
+            ok = pre_processor(file_name);
+            if (ok)
+                compile(file_name);
+        }
+        if (!ok)
+            diag_printf("\nErrors in Macros declarations and implematation, failed to process file '%s.\n", source->name);
+    } else {
+        ok = 0;
+        failed = 1;
+    }
+    catch_fatal(prev_fatal);
+    diag_redirect(prev);
+    probe1(file_end, file_name);
+
+    /* The am_file is only a step of the compile */
+    printf("%s\n", STREAM_FORMAT);
+    for (i = 1; i < cnt_files; i++) {
+        dot = strrchr(files[i].name, '.');
+        if (files[i].fp == NULL && dot != NULL && strcmp(dot, MACRO_FILE) != 0)
+            write_section(stdout, dot + 1, files[i].text, files[i].len);
+    }
+    write_section(stdout, "diag", diag.text, diag.len);
+    printf("end %d\n", !ok || has_error);
+    fflush(stdout);
+
+    diag_clear(&diag);
+    for (i = 0; i < cnt_files; i++) {
+        asm_free(files[i].name);
+        asm_free(files[i].text);
+    }
+    return failed || ferror(stdout) ? 1 : 0;
+}
+
+/* Checks if the files are kept in memory */
+int streaming() {
+    return stream_on;
+}
+
+/* Opens a file for reading, in stream mode the source and the outputs are read from memory */
+FILE *open_input(char *name) {
+    memory_file *file;
+    struct stat st;
+    FILE *fp = NULL;
+
+    if (!stream_on) {
+        /* The I/O backend may have the file in memory */
+        if ((fp = async_open_read(name)) != NULL)
+            return fp;
+        if ((fp = fopen(name, "r")) != NULL && fstat(fileno(fp), &st) == 0)
+            stats_count(stat_bytes_read, st.st_size);
+        return fp;
+    }
+    pthread_mutex_lock(&files_lock);
+    if ((file = find_file(name)) != NULL && file->fp == NULL) {
+        /* fmemopen wants at least one byte, an empty file starts at its end */
+        fp = fmemopen(file->len > 0 ? file->text : "", file->len > 0 ? file->len : 1, "r");
+        if (fp != NULL && file->len == 0)
+            fseek(fp, 0, SEEK_END);
+        stats_count(stat_bytes_read, file->len);
+    }
+    pthread_mutex_unlock(&files_lock);
+    return fp;
+}
+
+/* Opens an output in memory, it replaces a file of the same name when it is closed */
+FILE *stream_open(char *name) {
+    memory_file *file;
+    FILE *fp = NULL;
+
+    pthread_mutex_lock(&files_lock);
+    if (cnt_files < MAX_STREAM_FILES) {
+        file = &files[cnt_files];
+        file->name = (char *)asm_malloc(strlen(name) + 1);
+        valid_allocate(file->name);
+        strcpy(file->name, name);
+        file->text = NULL;
+        file->len = 0;
+        if ((fp = file->fp = open_memstream(&file->text, &file->len)) != NULL)
+            cnt_files++;
+        else
+            asm_free(file->name);
+    }
+    pthread_mutex_unlock(&files_lock);
+    return fp;
+}
+
+/* Drops an output in memory */
+void stream_discard(FILE *fp, char *name) {
+    int i;
+
+    pthread_mutex_lock(&files_lock);
+    for (i = 0; i < cnt_files && files[i].fp != fp; i++)
+        ;
+    fclose(fp);
+    if (i < cnt_files)
+        remove_file(i);
+    pthread_mutex_unlock(&files_lock);
+}
+
+/* Completes an output in memory, returns 0 on failure */
+int stream_close(FILE *fp, char *name) {
+    memory_file *old;
+    int i, ok;
+
+    pthread_mutex_lock(&files_lock);
+    for (i = 0; i < cnt_files && files[i].fp != fp; i++)
+        ;
+    ok = fclose(fp) == 0 && i < cnt_files;
+    if (i < cnt_files) {
+        files[i].fp = NULL;
+        old = find_file(name);
+        if (ok && old != &files[i]) {
+            /* The complete file takes the place of the older one */
+            asm_free(old->text);
+            old->text = files[i].text;
+            old->len = files[i].len;
+            files[i].text = NULL;
+        }
+        if (!ok || old != &files[i])
+            remove_file(i);
+    }
+    pthread_mutex_unlock(&files_lock);
+    return ok;
+}
+
+/* Reads all of the stream, returns NULL if it can't be read */
+static char *read_all(FILE *fp, size_t *len) {
+    size_t size = READ_CHUNK;
+    char *text = (char *)asm_malloc(size);
+
+    valid_allocate(text);
+    *len = 0;
+    while (!feof(fp)) {
+        if (*len == size) {
+            size *= 2;
+            text = (char *)asm_realloc(text, size);
+            valid_allocate(text);
+        }
+        *len += fread(text + *len, 1, size - *len, fp);
+        if (ferror(fp)) {
+            asm_free(text);
+            return NULL;
+        }
+    }
+    return text;
+}
+
+/* Finds the complete file of the name, or the first one if none is complete, NULL if there is none */
+static memory_file *find_file(char *name) {
+    memory_file *found = NULL;
+    int i;
+
+    for (i = 0; i < cnt_files; i++) {
+        if (strcmp(files[i].name, name) == 0 && (found == NULL || found->fp != NULL))
+            found = &files[i];
+    }
+    return found;
+}
+
+/* Frees a file and removes it from the list */
+static void remove_file(int i) {
+    asm_free(files[i].name);
+    asm_free(files[i].text);
+    for (; i + 1 < cnt_files; i++)
+        files[i] = files[i + 1];
+    cnt_files--;
+}
+
+/* Writes a section of the stream */
+static void write_section(FILE *out, const char *type, const char *text, size_t len) {
+    fprintf(out, "%s %lu\n", type, (unsigned long)len);
+    if (len > 0)
+        fwrite(text, 1, len, out);
+}
@@ -0,0 +1,31 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdio.h>
+
+/* Stream mode: the source is read from stdin and the outputs are written to stdout,
+ * no file is read or written. The files of the compile are kept in memory.
+ *
+ * The stream is the line "asm-stream 1", then a section for every output which was
+ * written, in the order they were written: a line "<type> <len>" and len bytes, where
+ * type is the extension of the file ("ob", "ent", "ext" and the --emit formats).
+ * Then the section "diag" with the errors and warnings, and the line "end <status>",
+ * status is 0 if the source had no errors. */
+
+/* Compiles stdin and writes the stream to stdout, file_name is the name shown in the errors.
+ * Returns 1 if the compile had a fatal error or the stream couldn't be written */
+int assemble_stream(char *file_name);
+
+/* Checks if the files are kept in memory */
+int streaming();
+
+/* Opens a file for reading, in stream mode the source and the outputs are read from memory,
+ * with --io the files which the I/O backend has in memory */
+FILE *open_input(char *name);
+
+/* Opens, discards and closes an output in memory, like open_output, discard_output and close_output */
+FILE *stream_open(char *name);
+void stream_discard(FILE *fp, char *name);
+int stream_close(FILE *fp, char *name);
+
+#endif
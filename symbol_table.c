@@ -5,12 +5,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "symbol_table.h"
+#include "diag.h"
+#include "stats.h"
+#include "probes.h"
 
-extern int cnt_line;	/* line number to show in errors */
-extern bool has_error;	/* to prevent output file creation if an error was found */
-extern int ic;
-extern int dc;
-extern char *file_am_name;
+extern per_thread int cnt_line;	/* line number to show in errors */
+extern per_thread bool has_error;	/* to prevent output file creation if an error was found */
+extern per_thread int ic;
+extern per_thread int dc;
+extern per_thread char *file_am_name;
 
 struct symbol_node
 {
@@ -25,26 +28,28 @@ void add_symbol(node_ref list_head, int address, char symbol_name[MAX_SYMBOL_LEN
 {
 	symbol_node new_symbol;
 	symbol_node *found; 
+
+	stats_count(stat_symbols_inserted, 1);
 	/* If the symbol already exists */
 		if ((found = get_symbol(list_head, symbol_name)) != NULL)
 		{
             if(type == entry){
-				printf("**Warning**: redeclaration of a symbol as an entry in line %d\n", cnt_line);
+				diag_printf("**Warning**: redeclaration of a symbol as an entry in line %d\n", cnt_line);
 				return;
 			}
 			else if(type == external && address == 0 && found->type != external){
-				printf("\nError in %s, line %d: declartion of label as extern  but label already was defined locally\n", file_am_name, cnt_line);
+				diag_printf("\nError in %s, line %d: declartion of label as extern  but label already was defined locally\n", file_am_name, cnt_line);
 				has_error = TRUE;
 				return;
 			}
 			else if(type != external){
 				if(found->type == external){
-					printf("\nError in %s, line %d: defining label  but label already was declared as extern\n", file_am_name, cnt_line);
+					diag_printf("\nError in %s, line %d: defining label  but label already was declared as extern\n", file_am_name, cnt_line);
 					has_error = TRUE;
 					return;
 				}
 				else{
-					printf("\nError in %s, line %d: defining label ibut label was already defined\n", file_am_name, cnt_line);
+					diag_printf("\nError in %s, line %d: defining label ibut label was already defined\n", file_am_name, cnt_line);
 					has_error = TRUE;
 					return;
 				}
@@ -58,6 +63,7 @@ void add_symbol(node_ref list_head, int address, char symbol_name[MAX_SYMBOL_LEN
 
 	/* Adds the new symbol to the symbol list */
 	add_node(list_head, &new_symbol, sizeof(symbol_node));
+	probe3(symbol_insert, symbol_name, address, (int)type);
 } /* end of add_symbol */
 
 /* Retrieves a symbol with the specified name from the symbol list */
@@ -66,11 +72,13 @@ symbol_node *get_symbol(node_ref list_head, char symbol_name[MAX_SYMBOL_LENGTH])
 	symbol_node *curr; /* Current symbol node being checked */
 	node_ptr temp; /* Iterator for traversing the list */
 
-
+	stats_count(stat_symbols_looked_up, 1);
 	temp = *list_head;
 	/* If the list is empty, return null */
-	if (temp == NULL)
+	if (temp == NULL) {
+		probe1(symbol_miss, symbol_name);
 		return NULL;
+	}
 
 	/* Iterate through the list to find the matching symbol */
 	do
@@ -84,6 +92,7 @@ symbol_node *get_symbol(node_ref list_head, char symbol_name[MAX_SYMBOL_LENGTH])
 	} while ((temp = get_next(temp)) != NULL);
 
 	/* If no matching symbol was found, return null */
+	probe1(symbol_miss, symbol_name);
 	return NULL;
 } /* End of get_symbol */
 
@@ -47,12 +47,21 @@ char get_content(char* s);
 static char* split_ops(char **ops, char *src_ops, char *dest_ops, syntax_ast *sa);
 /* Split and extract operands from the given string and update the syntax_ast accordingly */
 
-bool is_printable(char *str);
-/* Check if the given string contains only printable characters */
+bool is_printable(char *str, int len);
+/* Check if the len chars of the string are only printable characters */
+
+text_span *operand_span(syntax_ast *sa);
+/* Returns the span of the operands of a .data or .string line, NULL if the operands are in the ast */
+
+const char *parse_data_list(char *text, int words[], int max_words, int *cnt);
+/* Parse a .data list of signed decimal values separated by commas to data words */
 
 
 
 #define find_first_space(ops) while (ops != NULL && *ops != '\0' && !isspace(*ops)) ops++; 
+#define is_digit(c) ((unsigned int)((c) - '0') < 10) /* without the locale lookup of isdigit */
+#define BYTES_ONES (~0UL / 255)      /* 1 in every byte of an unsigned long */
+#define BYTES_HIGHS (BYTES_ONES * 128) /* the high bit of every byte */
 
 typedef struct {
     const char *inst_name;     /* Name of the assembly instruction */
@@ -100,12 +109,12 @@ syntax_ast syntax_ast_parse(char *line_str) {
     int i = 0;
     syntax_ast sa = {0};
 
-    /* Allocate memory for line and verify allocation */
-    line = (char*) calloc(MAX_LINE_LENGTH, sizeof(char));
+    /* Allocate memory for line and verify allocation, with --long-lines a line may be longer than MAX_LINE_LENGTH */
+    line = (char*) asm_malloc(strlen(line_str) + 1);
     valid_allocate(line);
     
     /* Copy the input line to 'line' */
-    strncpy(line, line_str, strlen(line_str));
+    strcpy(line, line_str);
     initial = line;
 
     /* Trim leading spaces from line */
@@ -115,7 +124,7 @@ syntax_ast syntax_ast_parse(char *line_str) {
 
     /* Check for label existence and handle error case */
     if (find_label(&line, &sa) == -1) {
-        free(initial);
+        asm_free(initial);
         return sa;
     }
 
@@ -127,14 +136,14 @@ syntax_ast syntax_ast_parse(char *line_str) {
     /* Handle cases with no data or instructions after label declaration */
     if ((line == NULL || *line == '\0') && *(sa.label_name) != '\0') {
         sprintf(sa.syntax_error, "Error: Declaration of symbol with no data or instructions");
-        free(initial);
+        asm_free(initial);
         return sa;
     }
 
     /* Divide the line into command and ops */
     ops = line;
     find_first_space(ops);
-    if (ops != NULL) {
+    if (ops != NULL && *ops != '\0') {
         *ops = '\0';
         ops++; /* Move ops pointer to the start of operands */
     }
@@ -147,11 +156,16 @@ syntax_ast syntax_ast_parse(char *line_str) {
             sa.opt_ast = direct;
             sa.dir_inst.direct.dir_opt = dir.dir_opt;
             valid_ops_direct(ops, dir.dir_opt, &sa);
-            free(initial);
+            /* The span points into the copy, which is freed, move it to the same place in the caller's line */
+            if (sa.dir_inst.direct.span.line != NULL) {
+                sa.dir_inst.direct.span.start = sa.dir_inst.direct.span.line - initial;
+                sa.dir_inst.direct.span.line = line_str;
+            }
+            asm_free(initial);
             return sa;
         } else {
             sprintf(sa.syntax_error, "Error: unknown command name");
-            free(initial);
+            asm_free(initial);
             return sa;
         }
     }
@@ -162,11 +176,11 @@ syntax_ast syntax_ast_parse(char *line_str) {
         sa.opt_ast = instruct;
         sa.dir_inst.instruct.inst_opt = inst.inst_opt;
         valid_ops_instruct(ops, inst.source_ops, inst.dest_ops, &sa);
-        free(initial);
+        asm_free(initial);
         return sa;
     } else {
         sprintf(sa.syntax_error, "Error: unknown command name");
-        free(initial);
+        asm_free(initial);
         return sa;
     }
 }
@@ -471,7 +485,12 @@ static void valid_ops_direct(char *ops_str, enum direct_opt dir_opt, syntax_ast
         return;
     }
     if (sa->dir_inst.direct.dir_opt == opt_entry || sa->dir_inst.direct.dir_opt == opt_extern) {
-        char symbol[MAX_SYMBOL_LENGTH];
+        char symbol[MAX_SYMBOL_LENGTH + 1];
+        /* A long line may hold a longer word than the buffer */
+        if (strlen(trim_string(ops_str)) > MAX_SYMBOL_LENGTH) {
+            sprintf(sa->syntax_error, "Error: invalid length of label");
+            return;
+        }
         strcpy(symbol, trim_string(ops_str)); /* Trim and store the symbol */
         if (valid_label(symbol, sa)) {
             strcpy(sa->dir_inst.direct.direct_params.symbol, symbol);
@@ -516,88 +535,74 @@ int valid_num(char *op, int min, int max, bool is_negative) {
 
 /* Validate a data operand and store it in the syntax_ast */
 static void valid_data(char *ops_str, syntax_ast *sa) {
-    int num = 0, cnt = 0, prev_comma = 1 , is_negative = 0; 
-    char curr; 
-    curr = get_content(ops_str);
-    
-    /* Check if the content of the string is 'E', indicating an error or empty string */
-    if (curr == 'E') /*was empty string*/
-    {
-        sprintf(sa->syntax_error, "Error: missing data");
+    int cnt;
+    const char *error;
+
+    /* The values after the first MAX_DATA_OPERANDS are read again from the line */
+    error = parse_data_list(ops_str, sa->dir_inst.direct.direct_params.data_s.data_arr, MAX_DATA_OPERANDS, &cnt);
+    if (error != NULL) {
+        strcpy(sa->syntax_error, error);
         return;
     }
-    
-    /* Check if the first character is a digit, minus sign, or plus sign */
-    if (isdigit(curr) || curr == '-' || curr == '+') {
-    /* Iterate through the input string */
-    while (ops_str != NULL && *ops_str != '\0') {
-        erase_spaces(ops_str);
-
-        /* Check for end of string */
-        if (*ops_str == '\0') {
-            break;
-        }
+    sa->dir_inst.direct.direct_params.data_s.cnt_data = cnt; /* Store the count of data elements */
+    if (cnt > MAX_DATA_OPERANDS) {
+        sa->dir_inst.direct.span.line = ops_str;
+        sa->dir_inst.direct.span.len = strlen(ops_str);
+    }
+}
 
+/* Parse a .data list of signed decimal values separated by commas to data words */
+const char *parse_data_list(char *text, int words[], int max_words, int *cnt) {
+    const unsigned char *p = (const unsigned char *)text;
+    unsigned int num;
+    int value;
+    bool is_negative, prev_comma = TRUE;
+
+    *cnt = 0;
+    /* Check if the list is empty, get_content gives 'E' for an empty string so a list starting with 'E' is reported as empty */
+    if (*p == '\0' || *p == 'E')
+        return "Error: missing data";
+    /* Check if the first character is a digit, minus sign, or plus sign */
+    if (!is_digit(*p) && *p != '-' && *p != '+')
+        return *p == ',' ? "Error: illegal comma" : "Error: illegal char";
+
+    for (;;) {
+        while (isspace(*p))
+            p++;
+        if (*p == '\0')
+            return NULL;
         /* Check for comma separator */
-        if (*ops_str == ',') {
-            if (prev_comma) {
-                sprintf(sa->syntax_error, "Error: illegal comma");
-                return;
-            } else {
-                prev_comma = 1; /* Mark that a comma was encountered */
-                ops_str++;
-            }
-        }
-        /* Process numeric data elements */
-        else if (isdigit(*ops_str) || *ops_str == '-' || *ops_str == '+') {
-            if (prev_comma == 0) {
-                sprintf(sa->syntax_error, "Error: missing comma");
-                return;
-            }
-            if (*ops_str == '+') {
-                ops_str++; /* Move past the plus sign */
-            }
-            if (*ops_str == '-') {
-                is_negative = 1; /* Mark the number as negative */
-                ops_str++; /* Move past the minus sign */
-            }
-            /* Convert digits to form a number */
-            while (*ops_str != '\0' && isdigit(*ops_str)) {
-                num = num * 10 + (*ops_str - '0');
-                ops_str++;
-            }
-            if (is_negative) {
-                num = -num; /* Apply the negative sign if necessary */
-                is_negative = 0;
-            }
-            /* Check if the number is within valid range */
-            if (num > MIN_DATA && num < MAX_DATA) {
-                sa->dir_inst.direct.direct_params.data_s.data_arr[cnt++] = num;
-                prev_comma = 0; /* Reset the comma flag */
-                num = 0; /* Reset temporary number storage */
-            } else {
-                sprintf(sa->syntax_error, "Error: illegal integer");
-                return;
-            }
-        } else {
-            sprintf(sa->syntax_error, "Error: illegal char in data operands");
-            return;
+        if (*p == ',') {
+            if (prev_comma)
+                return "Error: illegal comma";
+            prev_comma = TRUE;
+            p++;
+            continue;
         }
+        if (!is_digit(*p) && *p != '-' && *p != '+')
+            return "Error: illegal char in data operands";
+        if (!prev_comma)
+            return "Error: missing comma";
+
+        /* A value: an optional '+', an optional '-' and the digits, converted in one run */
+        if (*p == '+')
+            p++;
+        is_negative = *p == '-';
+        if (is_negative)
+            p++;
+        for (num = 0; is_digit(*p); p++)
+            num = num * 10 + (*p - '0');
+        value = (int)(is_negative ? 0U - num : num);
+
+        /* Check if the number is within valid range, the bounds are not valid values */
+        if (value <= MIN_DATA || value >= MAX_DATA)
+            return "Error: illegal integer";
+        if (*cnt < max_words)
+            words[*cnt] = (unsigned short)value;
+        (*cnt)++;
+        prev_comma = FALSE;
     }
 }
-else 
-{
-    /* Handle cases where the input does not start with a valid data element */
-    if (curr == ',') {
-        sprintf(sa->syntax_error, "Error: illegal comma");
-        return;
-    } else {
-        sprintf(sa->syntax_error, "Error: illegal char");
-        return;
-    }
-}
-    sa->dir_inst.direct.direct_params.data_s.cnt_data = cnt; /* Store the count of data elements */
-}
 
 /* Validate a string operand and store it in the syntax_ast */
 static void valid_string(char* ops_str, syntax_ast *sa) {
@@ -629,16 +634,15 @@ static void valid_string(char* ops_str, syntax_ast *sa) {
         return;
     }
     
-    *endptr = '\0'; /* Replace the closing quotation mark with a null terminator */
-    
     /* Check if the string contains unprintable characters */
-    if (!is_printable(ops_str)) {
+    if (!is_printable(ops_str, endptr - ops_str)) {
         sprintf(sa->syntax_error, "Error: string includes unprintable characters");
         return;
     }
     
-    /* Copy the validated string to the syntax_ast */
-    strcpy(sa->dir_inst.direct.direct_params.string, ops_str);
+    /* The string isn't copied, the encoder widens its chars from the line to data words */
+    sa->dir_inst.direct.span.line = ops_str;
+    sa->dir_inst.direct.span.len = endptr - ops_str;
     
     endptr++; /* Move to the next character after the string's closing quotation mark */
     
@@ -653,12 +657,28 @@ static void valid_string(char* ops_str, syntax_ast *sa) {
     return;
 }
 
-/* Check if the given string contains only printable characters */
-bool is_printable(char *str) {
-    int i;
-    for (i = 0; str[i] != '\0'; i++) {
+/* Returns the span of the operands of a .data or .string line, NULL if the operands are in the ast */
+text_span *operand_span(syntax_ast *sa) {
+    if (sa->opt_ast != direct || sa->dir_inst.direct.span.line == NULL)
+        return NULL;
+    return &sa->dir_inst.direct.span;
+}
+
+/* Check if the len chars of the string are only printable characters, the chars of a long are checked at once */
+bool is_printable(char *str, int len) {
+    unsigned long word;
+    int i = 0;
+
+    for (; i + (int)sizeof(word) <= len; i += sizeof(word)) {
+        memcpy(&word, str + i, sizeof(word));
+        /* A byte below 32 borrows into its high bit when 32 is subtracted, a byte above 126 has its
+         * high bit set after adding 1. A carry or a borrow only comes from such a byte */
+        if ((((word - BYTES_ONES * 32) & ~word) | (word + BYTES_ONES) | word) & BYTES_HIGHS)
+            return FALSE; /* Unprintable character found*/
+    }
+    for (; i < len; i++) {
         /* Check if the ASCII value of the character is less than 32 or greater than 126*/
-        if (str[i] < 32 || str[i] > 126) {
+        if ((unsigned char)str[i] < 32 || (unsigned char)str[i] > 126) {
             return FALSE; /* Unprintable character found*/
         }
     }
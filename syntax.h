@@ -44,20 +44,30 @@ enum op_method{
     reg_num_op=5
 };
 
+#define MAX_DATA_OPERANDS 80 /* values of .data kept in the ast */
+
 /*handling data*/
 typedef struct{
-    int data_arr[80];
+    int data_arr[MAX_DATA_OPERANDS];
     int cnt_data;
 }data;
 
+/* operands which are read from the text of the line when the data is encoded: the chars of a .string,
+ * and the values of a .data which don't fit in the ast (only with --long-lines) */
+typedef struct{
+    char *line;  /* the line given to syntax_ast_parse, NULL if the operands are in the ast */
+    int start;   /* first char of the operands in the line */
+    int len;     /* chars of the operands */
+}text_span;
+
 /*ast which represents directions sentences*/
 typedef struct{
     enum direct_opt dir_opt;
     union{
         char symbol[MAX_SYMBOL_LENGTH];
-        char string[MAX_LINE_LENGTH];
         data data_s;
     }direct_params;
+    text_span span; /* cnt_data still holds the number of values of a .data span */
 }direct_ast;
 
 /*ast which represents instruction sentences*/
@@ -85,7 +95,15 @@ typedef struct{
     }dir_inst;
 }syntax_ast;
 
-/*build abstract syntax tree from the given line*/
+/*build abstract syntax tree from the given line, a span of the ast points into the line*/
 syntax_ast syntax_ast_parse (char *line);
 
+/* Returns the span of the operands of a .data or .string line, NULL if the operands are in the ast */
+text_span *operand_span(syntax_ast *sa);
+
+/* Parses a .data list of signed decimal values separated by commas to data words (the values as unsigned short).
+ * The separators and the range of every value are checked in the same pass which converts it. The first max_words
+ * words are stored, all of them are counted in cnt. Returns the error of the list, NULL if it is valid */
+const char *parse_data_list(char *text, int words[], int max_words, int *cnt);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+/* thread_pool.c runs independent tasks on several threads */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "thread_pool.h"
+#include "options.h"
+
+#define MAX_JOBS 256
+
+/* the items of one parallel_for, handed out in order */
+typedef struct {
+    int cnt;
+    int next;          /* next index to handle, taken with an atomic add */
+    index_task task;
+    void *arg;
+} work_range;
+
+/*** functions prototypes ***/
+
+/* Handles indexes until none are left */
+static void *run_range(void *arg);
+
+
+/* Calls task for every index in [0, cnt) on up to jobs threads, returns when all are done */
+void parallel_for(int cnt, int jobs, index_task task, void *arg) {
+    pthread_t threads[MAX_JOBS];
+    work_range range;
+    int i, cnt_threads;
+
+    range.cnt = cnt;
+    range.next = 0;
+    range.task = task;
+    range.arg = arg;
+
+    if (jobs > MAX_JOBS)
+        jobs = MAX_JOBS;
+    cnt_threads = jobs < cnt ? jobs : cnt;
+
+    /* The calling thread is one of the workers */
+    for (i = 0; i < cnt_threads - 1; i++) {
+        if (pthread_create(&threads[i], NULL, run_range, &range) != 0) {
+            cnt_threads = i + 1; /* go on with the threads we have */
+            break;
+        }
+    }
+    run_range(&range);
+    for (i = 0; i < cnt_threads - 1; i++)
+        pthread_join(threads[i], NULL);
+}
+
+/* Handles indexes until none are left */
+static void *run_range(void *arg) {
+    work_range *range = (work_range *)arg;
+    int index;
+
+    while ((index = __atomic_fetch_add(&range->next, 1, __ATOMIC_RELAXED)) < range->cnt)
+        range->task(index, range->arg);
+    return NULL;
+}
+
+/* Number of threads to use when --jobs is not given */
+int default_jobs() {
+    long cnt;
+
+    if (options.jobs > 0)
+        return options.jobs;
+    cnt = sysconf(_SC_NPROCESSORS_ONLN);
+    return cnt > 0 ? (int)cnt : 1;
+}
@@ -0,0 +1,14 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+/* receives the index of the item to handle */
+typedef void (*index_task)(int index, void *arg);
+
+/* Calls task for every index in [0, cnt) on up to jobs threads, returns when all are done.
+ * The calling thread takes part, so the task may change its per_thread state */
+void parallel_for(int cnt, int jobs, index_task task, void *arg);
+
+/* Number of threads to use when --jobs is not given */
+int default_jobs();
+
+#endif
@@ -0,0 +1,106 @@
+/*** trace.c records the phases of the files on a timeline and writes it for a trace viewer ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "define.h"
+#include "trace.h"
+
+/* an event of the timeline */
+typedef struct {
+    char kind;             /* 'B' or 'E' */
+    const char *phase;
+    const char *file_name;
+    int tid;
+    double ts;             /* microseconds since the start */
+} trace_record;
+
+static char *trace_path = NULL;
+static struct timespec trace_begin;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_record *records = NULL;
+static int cnt_records = 0, size_records = 0;
+static int cnt_threads = 0;
+static per_thread int thread_id = 0;   /* 0 before the first event of the thread */
+
+/*** functions prototypes ***/
+
+/* Prints a JSON string */
+static void print_string(FILE *out, const char *text);
+
+
+/* Starts recording, the events are written to the file by trace_finish */
+void trace_start(char *path) {
+    clock_gettime(CLOCK_MONOTONIC, &trace_begin);
+    trace_path = path;
+}
+
+/* Checks if the events are recorded */
+int trace_on() {
+    return trace_path != NULL;
+}
+
+/* Records that the thread begins or ends a phase of a file at the time */
+void trace_event(char kind, const char *phase, const char *file_name, struct timespec *at) {
+    trace_record *rec;
+
+    pthread_mutex_lock(&trace_lock);
+    if (thread_id == 0)
+        thread_id = ++cnt_threads;
+    if (cnt_records == size_records) {
+        size_records = size_records == 0 ? 1024 : size_records * 2;
+        records = (trace_record *)asm_realloc(records, size_records * sizeof(trace_record));
+        valid_allocate(records);
+    }
+    rec = &records[cnt_records++];
+    rec->kind = kind;
+    rec->phase = phase;
+    rec->file_name = file_name;
+    rec->tid = thread_id;
+    rec->ts = (at->tv_sec - trace_begin.tv_sec) * 1e6 + (at->tv_nsec - trace_begin.tv_nsec) / 1e3;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* Writes the events to the file */
+void trace_finish() {
+    FILE *out;
+    int i;
+
+    if (trace_path == NULL)
+        return;
+    if ((out = fopen(trace_path, "w")) == NULL) {
+        printf("Error: can't create file: %s\n", trace_path);
+        return;
+    }
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"assembler\"}}");
+    for (i = 1; i <= cnt_threads; i++)
+        fprintf(out, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}", i, i);
+    for (i = 0; i < cnt_records; i++) {
+        fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"phase\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d, \"args\": {\"file\": ",
+                records[i].phase, records[i].kind, records[i].ts, records[i].tid);
+        print_string(out, records[i].file_name);
+        fprintf(out, "}}");
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    asm_free(records);
+    records = NULL;
+    cnt_records = size_records = 0;
+    trace_path = NULL;
+}
+
+/* Prints a JSON string */
+static void print_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\')
+            fprintf(out, "\\%c", *text);
+        else if ((unsigned char)*text < 0x20)
+            fprintf(out, "\\u%04x", (unsigned char)*text);
+        else
+            fputc(*text, out);
+    }
+    fputc('"', out);
+}
@@ -0,0 +1,23 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <time.h>
+
+/* Timeline of the run (--trace FILE) in the Chrome trace event format: a begin and an
+ * end event for every phase of every file, on the thread which ran it. The phases
+ * are the ones of stats.h, the events are recorded when a thread enters and leaves them. */
+
+/* Starts recording, the events are written to the file by trace_finish */
+void trace_start(char *path);
+
+/* Checks if the events are recorded */
+int trace_on();
+
+/* Records that the thread begins ('B') or ends ('E') a phase of a file at the time.
+ * The names are kept until trace_finish */
+void trace_event(char kind, const char *phase, const char *file_name, struct timespec *at);
+
+/* Writes the events to the file */
+void trace_finish();
+
+#endif
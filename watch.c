@@ -0,0 +1,145 @@
+/*** watch.c compiles the files again whenever they are saved ***/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "define.h"
+#include "diag.h"
+#include "pre_processor.h"
+#include "incremental.h"
+#include "watch.h"
+#include "probes.h"
+
+/* events of a saved file: written in place, or renamed over the old one */
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define EVENTS_SIZE 4096
+
+/* a file being watched */
+typedef struct {
+    char *name;            /* the file name without extension */
+    char *asfile_name;
+    char *base;            /* the name of the as_file in its directory */
+    int wd;                /* watch of the directory */
+    bool changed;
+    inc_state *state;      /* the state of the last compile */
+} watched_file;
+
+/*** functions prototypes ***/
+
+/* Watches the directory of the file, editors often save by renaming a new file over it */
+static int watch_dir(int fd, watched_file *wf);
+
+/* Compiles the file with its state and prints the time it took */
+static void rebuild(watched_file *wf);
+
+/* Frees the first cnt watched files and closes the inotify descriptor */
+static void unwatch(int fd, watched_file watched[], int cnt);
+
+
+/* Compiles the files and watches them until killed, returns the exit status */
+int watch_files(char *files[], int cnt) {
+    watched_file *watched;
+    char events[EVENTS_SIZE];
+    struct inotify_event *ev;
+    long len, pos;
+    int fd, i;
+
+    if ((fd = inotify_init()) < 0) {
+        diag_printf("Error: can't watch the files\n");
+        return 1;
+    }
+    watched = (watched_file *)asm_calloc(cnt + 1, sizeof(watched_file));
+    valid_allocate(watched);
+    for (i = 0; i < cnt; i++) {
+        watched[i].name = files[i];
+        watched[i].asfile_name = name_file(files[i], INPUT_FILE);
+        watched[i].base = strrchr(watched[i].asfile_name, '/');
+        watched[i].base = watched[i].base == NULL ? watched[i].asfile_name : watched[i].base + 1;
+        watched[i].state = state_create();
+        if (watch_dir(fd, &watched[i]) < 0) {
+            diag_printf("Error: can't watch file: %s\n", watched[i].asfile_name);
+            unwatch(fd, watched, i + 1);
+            return 1;
+        }
+        rebuild(&watched[i]);
+    }
+
+    for (;;) {
+        if ((len = read(fd, events, sizeof(events))) <= 0)
+            break;
+        /* A save may send several events, the file is compiled once */
+        for (pos = 0; pos < len; pos += sizeof(struct inotify_event) + ev->len) {
+            ev = (struct inotify_event *)(events + pos);
+            for (i = 0; i < cnt; i++) {
+                if (ev->wd == watched[i].wd && ev->len > 0 && strcmp(ev->name, watched[i].base) == 0)
+                    watched[i].changed = TRUE;
+            }
+        }
+        for (i = 0; i < cnt; i++) {
+            if (watched[i].changed) {
+                watched[i].changed = FALSE;
+                rebuild(&watched[i]);
+            }
+        }
+    }
+
+    unwatch(fd, watched, cnt);
+    return 1;
+}
+
+/* Frees the first cnt watched files and closes the inotify descriptor */
+static void unwatch(int fd, watched_file watched[], int cnt) {
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        state_destroy(watched[i].state);
+        asm_free(watched[i].asfile_name);
+    }
+    asm_free(watched);
+    close(fd);
+}
+
+/* Watches the directory of the file, editors often save by renaming a new file over it */
+static int watch_dir(int fd, watched_file *wf) {
+    char *dir;
+    long dir_len = wf->base - wf->asfile_name;
+
+    dir = (char *)asm_malloc(dir_len + 2);
+    valid_allocate(dir);
+    if (dir_len == 0) {
+        strcpy(dir, ".");
+    } else {
+        strncpy(dir, wf->asfile_name, dir_len);
+        dir[dir_len] = '\0';
+    }
+    /* The directory of several files is watched once, they share the watch */
+    wf->wd = inotify_add_watch(fd, dir, WATCH_EVENTS);
+    asm_free(dir);
+    return wf->wd;
+}
+
+/* Compiles the file with its state and prints the time it took */
+static void rebuild(watched_file *wf) {
+    struct timespec start, end;
+    jmp_buf fatal, *prev_fatal;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    probe1(file_start, wf->name);
+    /* A file which can't be opened now may be saved again later */
+    prev_fatal = catch_fatal(&fatal);
+    if (setjmp(fatal) == 0) {
+        if (!pre_processor(wf->name))
+            diag_printf("\nErrors in Macros declarations and implematation, failed to process file '%s.\n", wf->asfile_name);
+        else
+            compile_with_state(wf->name, wf->state);
+    }
+    catch_fatal(prev_fatal);
+    probe1(file_end, wf->name);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    diag_printf("\nAssembled %s in %.2f ms\n", wf->asfile_name,
+                (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    fflush(stdout);
+}
@@ -0,0 +1,11 @@
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+/* Watch mode: the files are compiled, then compiled again every time one of
+ * them is saved. The state of every file stays in memory between the compiles,
+ * so only the lines which changed are parsed again (see incremental.h). */
+
+/* Compiles the files and watches them until killed, returns the exit status */
+int watch_files(char *files[], int cnt);
+
+#endif